@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "balance_mpi.h"
+
+// Lowest weight an update leaves, relative to the mean
+#define MIN_WEIGHT 0.05
+
+// Scale `weights` to a mean of 1
+static void normalise(double* weights, int size) {
+    double sum = 0.0;
+    for (int r = 0; r < size; r++) sum += weights[r];
+    for (int r = 0; r < size; r++) weights[r] *= size / sum;
+}
+
+static void even(double* weights, int size) {
+    for (int r = 0; r < size; r++) weights[r] = 1.0;
+}
+
+void mpi_calibrate_weights(hpc_filter_kind kind, const hpc_smooth_params* smooth,
+                           int num_threads, double budget, MPI_Comm comm, double* weights) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // a fixed textured image, so every rank does exactly the same work
+    enum { CAL_WIDTH = 512, CAL_HEIGHT = 128 };
+    unsigned char* img = malloc((size_t)CAL_WIDTH * CAL_HEIGHT * 3);
+    unsigned char* out = malloc((size_t)CAL_WIDTH * CAL_HEIGHT * 3);
+    if (!img || !out) {
+        fprintf(stderr, "Rank %d: out of memory for the calibration image\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    for (size_t i = 0; i < (size_t)CAL_WIDTH * CAL_HEIGHT * 3; i++)
+        img[i] = (unsigned char)((i * 37) ^ (i >> 7));
+    image_view in = image_view_packed(img, CAL_WIDTH, CAL_HEIGHT);
+    image_view dst = image_view_packed(out, CAL_WIDTH, CAL_HEIGHT);
+    hpc_exec_ctx exec = hpc_exec_defaults();
+    exec.num_threads = num_threads;
+
+    // one untimed run warms caches and thread pools
+    hpc_filter_run(kind, &in, &dst, smooth, &exec);
+    MPI_Barrier(comm);
+    int reps = 0;
+    double start = MPI_Wtime(), elapsed;
+    do {
+        hpc_filter_run(kind, &in, &dst, smooth, &exec);
+        reps++;
+        elapsed = MPI_Wtime() - start;
+    } while (elapsed < budget);
+    free(img);
+    free(out);
+
+    double rate = reps / elapsed;
+    MPI_Allgather(&rate, 1, MPI_DOUBLE, weights, 1, MPI_DOUBLE, comm);
+    normalise(weights, size);
+}
+
+void mpi_update_weights(double* weights, double seconds, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    double* times = malloc((size_t)size * sizeof(double));
+    if (!times) {
+        fprintf(stderr, "Out of memory for the rank timings\n");
+        MPI_Abort(comm, 1);
+    }
+    MPI_Allgather(&seconds, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, comm);
+
+    int measured = 1;
+    for (int r = 0; r < size; r++) measured = measured && times[r] > 0.0;
+    if (measured) {
+        for (int r = 0; r < size; r++) times[r] = weights[r] / times[r];
+        normalise(times, size);
+        for (int r = 0; r < size; r++) weights[r] = 0.5 * (weights[r] + times[r]);
+        normalise(weights, size);
+        // a strip of a few rows times mostly overhead; never starve a rank on that
+        for (int r = 0; r < size; r++)
+            if (weights[r] < MIN_WEIGHT) weights[r] = MIN_WEIGHT;
+        normalise(weights, size);
+    }
+    free(times);
+}
+
+int mpi_read_weights(const char* path, MPI_Comm comm, double* weights) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int ok = 0;
+    if (rank == 0) {
+        FILE* f = fopen(path, "r");
+        if (f) {
+            int n = 0;
+            double w;
+            while (n <= size && fscanf(f, "%lf", &w) == 1) {
+                if (n < size) weights[n] = w;
+                n++;
+            }
+            ok = n == size && feof(f);
+            for (int r = 0; ok && r < size; r++) ok = weights[r] > 0.0 && isfinite(weights[r]);
+            fclose(f);
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    if (!ok) {
+        even(weights, size);
+        return 0;
+    }
+    MPI_Bcast(weights, size, MPI_DOUBLE, 0, comm);
+    normalise(weights, size);
+    return 1;
+}
+
+int mpi_write_weights(const char* path, const double* weights, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int ok = 1;
+    if (rank == 0) {
+        FILE* f = fopen(path, "w");
+        ok = f != NULL;
+        for (int r = 0; ok && r < size; r++) ok = fprintf(f, "%.6f\n", weights[r]) > 0;
+        if (f && fclose(f) != 0) ok = 0;
+        if (!ok) fprintf(stderr, "Error writing rank weights to %s\n", path);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    return ok;
+}
@@ -0,0 +1,35 @@
+// balance_mpi.h
+#ifndef BALANCE_MPI_H
+#define BALANCE_MPI_H
+
+#include <mpi.h>
+#include "hpcfilter.h"
+
+// Relative speeds of the ranks of a communicator, one weight per rank, for
+// strip_bounds: a rank of weight 2 gets twice the rows of a rank of weight 1. Every
+// function leaves the same weights on every rank, normalised to a mean of 1.
+
+// Short calibration pass: every rank runs `kind` on the same small synthetic image with
+// `num_threads` threads for about `budget` seconds, all ranks at once so that ranks
+// sharing a node slow each other as they will in the real run, and takes the rate it
+// reached as its weight. Collective.
+void mpi_calibrate_weights(hpc_filter_kind kind, const hpc_smooth_params* smooth,
+                           int num_threads, double budget, MPI_Comm comm, double* weights);
+
+// Fold a measured run into `weights`: a rank whose strip, sized by `weights`, took
+// `seconds` ran at weights[r] / seconds. The new weights average those rates with the
+// old weights, so one noisy run moves the split only halfway, and no rank drops below
+// a twentieth of the mean. Leaves `weights` unchanged if any rank measured no time.
+// Collective.
+void mpi_update_weights(double* weights, double seconds, MPI_Comm comm);
+
+// Read weights saved by mpi_write_weights on the root and broadcast them. Returns 0 on
+// every rank, with even weights, when the file is missing or holds a different number
+// of ranks. Collective.
+int mpi_read_weights(const char* path, MPI_Comm comm, double* weights);
+
+// Save `weights` from the root, one per line. Returns 0 on every rank if the file
+// cannot be written. Collective.
+int mpi_write_weights(const char* path, const double* weights, MPI_Comm comm);
+
+#endif
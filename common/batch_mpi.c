@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch_mpi.h"
+#include "utils.h"
+
+enum { TAG_READY = 1, TAG_JOB, TAG_STOP };
+
+// Value of "--name=value" if tok is that option, else NULL
+static const char* job_option(const char* tok, const char* name) {
+    size_t n = strlen(name);
+    return (strncmp(tok, name, n) == 0 && tok[n] == '=') ? tok + n + 1 : NULL;
+}
+
+int parse_batch_job(const char* line, batch_job* job) {
+    char input[512], output[512], filter[32], tok[64];
+    int used;
+    if (sscanf(line, "%511s %511s %31s%n", input, output, filter, &used) != 3) return 0;
+    if (!parse_hpc_filter(filter, &job->kind)) return 0;
+    build_paths(input, output, job->input, job->output);
+    job->smooth = hpc_smooth_defaults();
+
+    for (const char* p = line + used; sscanf(p, "%63s%n", tok, &used) == 1; p += used) {
+        const char* v;
+        int ok;
+        if ((v = job_option(tok, "--sigma"))) {
+            job->smooth.sigma = (float)atof(v);
+            ok = job->smooth.sigma > 0.0f;
+        } else if ((v = job_option(tok, "--method"))) {
+            ok = parse_gaussian_method(v, &job->smooth.method);
+        } else if ((v = job_option(tok, "--border"))) {
+            ok = parse_border_mode(v, &job->smooth.border);
+        } else {
+            ok = 0;
+        }
+        if (!ok) return 0;
+    }
+    return job->kind != HPC_FILTER_SMOOTH ||
+           (gaussian_border_supported(job->smooth.method, job->smooth.border) &&
+            gaussian_sigma_supported(job->smooth.method, job->smooth.sigma));
+}
+
+// Decode, filter and encode one image on this rank alone
+static int run_job(const batch_job* job, int num_threads) {
+    int width, height;
+    unsigned char* img = load_image(job->input, &width, &height);
+    if (!img) return 0;
+    unsigned char* out = malloc((size_t)width * height * 3);
+    image_view in = image_view_packed(img, width, height);
+    image_view dst = image_view_packed(out, width, height);
+    hpc_exec_ctx exec = hpc_exec_defaults();
+    exec.num_threads = num_threads;
+    int ok = out && hpc_filter_run(job->kind, &in, &dst, &job->smooth, &exec);
+    if (!ok) fprintf(stderr, "Filter %s failed on %s\n", hpc_filter_name(job->kind), job->input);
+    ok = ok && save_image(job->output, out, width, height);
+    free(out);
+    stbi_image_free(img);
+    return ok;
+}
+
+typedef struct {
+    batch_job job;
+    long long pixels;   // from the image header, 0 when it cannot be read
+    int line;
+} queued_job;
+
+// Largest image first; manifest order among equals
+static int larger_first(const void* a, const void* b) {
+    const queued_job *x = a, *y = b;
+    if (x->pixels != y->pixels) return x->pixels < y->pixels ? 1 : -1;
+    return x->line - y->line;
+}
+
+// Root side: read and sort the manifest. Returns NULL with `*count` -1 when the file
+// cannot be read.
+static queued_job* read_manifest(const char* manifest, int* count, int* malformed) {
+    *count = -1;
+    *malformed = 0;
+    FILE* f = fopen(manifest, "r");
+    if (!f) {
+        fprintf(stderr, "Error opening manifest %s\n", manifest);
+        return NULL;
+    }
+    queued_job* q = NULL;
+    int n = 0, cap = 0, line_no = 0;
+    char line[2048];
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        size_t len = strlen(line);
+        int too_long = len > 0 && line[len - 1] != '\n' && !feof(f);
+        if (too_long) {   // skip the rest; the line is malformed
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n') {}
+        }
+        const char* p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') continue;
+
+        batch_job job;
+        if (too_long || !parse_batch_job(p, &job)) {
+            fprintf(stderr, "%s:%d: malformed job\n", manifest, line_no);
+            (*malformed)++;
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            queued_job* grown = realloc(q, (size_t)cap * sizeof(queued_job));
+            if (!grown) {
+                fprintf(stderr, "Rank 0: out of memory for the manifest\n");
+                free(q);
+                fclose(f);
+                return NULL;
+            }
+            q = grown;
+        }
+        int w, h, c;
+        q[n].job = job;
+        q[n].pixels = stbi_info(job.input, &w, &h, &c) ? (long long)w * h : 0;
+        q[n].line = line_no;
+        n++;
+    }
+    fclose(f);
+    if (n) qsort(q, (size_t)n, sizeof(queued_job), larger_first);
+    *count = n;
+    return q;
+}
+
+int mpi_run_batch(const char* manifest, int num_threads, MPI_Comm comm, int* jobs, int* failed) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // jobs queued and failed so far (the malformed lines), -1 jobs when the manifest is
+    // unusable
+    int counts[2] = { 0, 0 };
+    queued_job* q = NULL;
+    if (rank == 0) q = read_manifest(manifest, &counts[0], &counts[1]);
+    MPI_Bcast(counts, 2, MPI_INT, 0, comm);
+    if (counts[0] < 0) return 0;
+    int malformed = counts[1];
+
+    if (size == 1) {
+        for (int i = 0; i < counts[0]; i++)
+            if (!run_job(&q[i].job, num_threads)) counts[1]++;
+    } else if (rank == 0) {
+        // each request carries the verdict on the worker's previous job (-1 for none);
+        // jobs travel as raw bytes, as every rank runs the same binary
+        int next = 0, working = size - 1, result;
+        MPI_Status status;
+        while (working > 0) {
+            MPI_Recv(&result, 1, MPI_INT, MPI_ANY_SOURCE, TAG_READY, comm, &status);
+            if (result == 0) counts[1]++;
+            if (next < counts[0]) {
+                MPI_Send(&q[next++].job, (int)sizeof(batch_job), MPI_BYTE, status.MPI_SOURCE,
+                         TAG_JOB, comm);
+            } else {
+                MPI_Send(NULL, 0, MPI_BYTE, status.MPI_SOURCE, TAG_STOP, comm);
+                working--;
+            }
+        }
+    } else {
+        int result = -1;
+        for (;;) {
+            batch_job job;
+            MPI_Status status;
+            MPI_Send(&result, 1, MPI_INT, 0, TAG_READY, comm);
+            MPI_Recv(&job, (int)sizeof(batch_job), MPI_BYTE, 0, MPI_ANY_TAG, comm, &status);
+            if (status.MPI_TAG == TAG_STOP) break;
+            result = run_job(&job, num_threads);
+        }
+    }
+    free(q);
+
+    MPI_Bcast(counts, 2, MPI_INT, 0, comm);
+    *jobs = counts[0] + malformed;
+    *failed = counts[1];
+    return 1;
+}
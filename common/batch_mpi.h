@@ -0,0 +1,31 @@
+// batch_mpi.h
+#ifndef BATCH_MPI_H
+#define BATCH_MPI_H
+
+#include <mpi.h>
+#include "hpcfilter.h"
+
+// One image of a batch: a manifest line
+//     input output filter [--sigma=S] [--method=M] [--border=B]
+// with the filter and options spelled as for the driver, and the paths resolved like
+// the executables' (build_paths)
+typedef struct {
+    char input[512], output[512];
+    hpc_filter_kind kind;
+    hpc_smooth_params smooth;
+} batch_job;
+
+// Parse one manifest line. Returns 0 for a malformed line or a smoothing method that
+// does not support the border or sigma asked for.
+int parse_batch_job(const char* line, batch_job* job);
+
+// Run every job of the manifest at `manifest`, read on the root, one whole image per
+// rank at a time: the root hands the jobs out largest first (by the pixel count in
+// their headers) to whichever worker asks next, and each worker decodes, filters with
+// `num_threads` OpenMP threads and encodes its image on its own. On a single rank the
+// root runs the jobs itself. Blank lines and lines starting with # are skipped; a
+// malformed line counts as a failed job. Collective; returns 0 on every rank when the
+// manifest cannot be read, else 1 with the job counts in `*jobs` and `*failed`.
+int mpi_run_batch(const char* manifest, int num_threads, MPI_Comm comm, int* jobs, int* failed);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <string.h>
+#include "border.h"
+
+int border_coord(int v, int n, border_mode mode) {
+    if (v >= 0 && v < n) return v;
+    switch (mode) {
+    case BORDER_REFLECT: {
+        if (n == 1) return 0;
+        int period = 2 * n - 2;
+        v %= period;
+        if (v < 0) v += period;
+        return (v < n) ? v : period - v;
+    }
+    case BORDER_WRAP:
+        v %= n;
+        return (v < 0) ? v + n : v;
+    case BORDER_CONSTANT:
+        return -1;
+    default:
+        return (v < 0) ? 0 : n - 1;
+    }
+}
+
+static const char* const border_names[] = {"clamp", "reflect", "wrap", "constant"};
+
+int parse_border_mode(const char* name, border_mode* mode) {
+    for (int i = 0; i <= BORDER_CONSTANT; i++) {
+        if (strcmp(name, border_names[i]) == 0) {
+            *mode = (border_mode)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* border_mode_name(border_mode mode) {
+    return border_names[mode];
+}
+
+int padded_image_init(padded_image* p, const image_view* img, int first_row, int rows,
+                      int pad, border_mode mode, unsigned char value) {
+    int width = img->width, height = img->height;
+    p->width = width;
+    p->rows = rows;
+    p->pad = pad;
+    p->stride = (size_t)(width + 2 * pad) * 3;
+    p->base = malloc((size_t)(rows + 2 * pad) * p->stride);
+    if (!p->base) return 0;
+    p->data = p->base + (size_t)pad * p->stride + (size_t)pad * 3;
+
+    // interior copies are plain memcpys; only the ghost columns are remapped
+    #pragma omp parallel for schedule(static)
+    for (int j = -pad; j < rows + pad; j++) {
+        unsigned char* dst = PADDED_AT(p, 0, j);
+        int sy = border_coord(first_row + j, height, mode);
+        if (sy < 0) {
+            memset(dst - pad * 3, value, p->stride);
+            continue;
+        }
+        const unsigned char* src = VIEW_ROW(img, sy);
+        memcpy(dst, src, (size_t)width * 3);
+        for (int x = -pad; x < 0; x++) {
+            int sx = border_coord(x, width, mode);
+            if (sx < 0) memset(dst + x * 3, value, 3);
+            else memcpy(dst + x * 3, src + sx * 3, 3);
+        }
+        for (int x = width; x < width + pad; x++) {
+            int sx = border_coord(x, width, mode);
+            if (sx < 0) memset(dst + x * 3, value, 3);
+            else memcpy(dst + x * 3, src + sx * 3, 3);
+        }
+    }
+    return 1;
+}
+
+void padded_image_free(padded_image* p) {
+    free(p->base);
+    p->base = p->data = NULL;
+}
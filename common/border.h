@@ -0,0 +1,34 @@
+// border.h
+#ifndef BORDER_H
+#define BORDER_H
+
+#include <stddef.h>
+#include "image_view.h"
+#include "filter_params.h"
+
+// Map coordinate v into [0, n) under `mode`, for any distance past the edge.
+// Returns -1 for BORDER_CONSTANT outside the image.
+int border_coord(int v, int n, border_mode mode);
+
+// Packed RGB rows [first_row, first_row + rows) of an image with a ghost border of `pad`
+// pixels on every side, filled once, so filters with a radius up to `pad` read their
+// taps directly with no per-tap remapping. Ghost rows above and below are the real
+// image rows where the image has them (a strip's halo), remapped past its edges.
+typedef struct {
+    unsigned char* base;   // allocation, including the border
+    unsigned char* data;   // pixel (0, 0) of the first covered row
+    int width, rows, pad;
+    size_t stride;         // bytes from one row to the next: (width + 2 * pad) * 3
+} padded_image;
+
+// Allocate and fill a padded strip of `img`, whose edges are the image edges. `value`
+// is the fill for BORDER_CONSTANT. Returns 0 on allocation failure.
+int padded_image_init(padded_image* p, const image_view* img, int first_row, int rows,
+                      int pad, border_mode mode, unsigned char value);
+
+void padded_image_free(padded_image* p);
+
+// Pixel (x, y) of a padded strip, -pad <= x < width + pad and -pad <= y < rows + pad
+#define PADDED_AT(p, x, y) ((p)->data + (ptrdiff_t)(y) * (ptrdiff_t)(p)->stride + (ptrdiff_t)(x) * 3)
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cpu_dispatch.h"
+
+static const char* const isa_names[] = {"scalar", "sse41", "avx2", "avx512"};
+
+static isa_level detect(void) {
+#ifdef ISA_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return ISA_SSE41;
+#endif
+    return ISA_SCALAR;
+}
+
+static isa_level bound_level;
+static pthread_once_t bind_once = PTHREAD_ONCE_INIT;
+
+// The only writer of the level and of every module's kernel pointers
+static void bind_all(void) {
+    isa_level level = detect(), forced;
+    const char* env = getenv("HPC_FILTER_ISA");
+    if (env && *env) {
+        if (!parse_isa_level(env, &forced))
+            fprintf(stderr, "Warning: unknown HPC_FILTER_ISA '%s', using %s\n", env, isa_names[level]);
+        else if (forced > level)
+            fprintf(stderr, "Warning: CPU lacks %s, using %s\n", env, isa_names[level]);
+        else
+            level = forced;
+    }
+    bound_level = level;
+    sobel_bind(level);
+    stencil_bind(level);
+    gaussian_bind(level);
+    fft_bind(level);
+}
+
+void cpu_dispatch_init(void) {
+    pthread_once(&bind_once, bind_all);
+}
+
+isa_level cpu_isa_level(void) {
+    cpu_dispatch_init();
+    return bound_level;
+}
+
+const char* isa_level_name(isa_level level) {
+    return isa_names[level];
+}
+
+int parse_isa_level(const char* name, isa_level* level) {
+    for (int i = 0; i <= ISA_AVX512; i++) {
+        if (strcmp(name, isa_names[i]) == 0) {
+            *level = (isa_level)i;
+            return 1;
+        }
+    }
+    return 0;
+}
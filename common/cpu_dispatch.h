@@ -0,0 +1,69 @@
+// cpu_dispatch.h
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+// Instruction set levels the SIMD kernels are built for, lowest first
+typedef enum {
+    ISA_SCALAR,
+    ISA_SSE41,
+    ISA_AVX2,
+    ISA_AVX512   // AVX-512F + BW
+} isa_level;
+
+// Probe the CPU and bind every dispatched module's kernels for the level, exactly once
+// per process (pthread_once), so library calls from several threads never race on the
+// kernel pointers. HPC_FILTER_ISA=scalar|sse41|avx2|avx512 is read here and forces a
+// lower level for testing; a level the CPU lacks is refused with a warning. Every
+// dispatched entry point calls this first; set HPC_FILTER_ISA before the first filter.
+void cpu_dispatch_init(void);
+
+// The level cpu_dispatch_init bound (running it if it has not run yet)
+isa_level cpu_isa_level(void);
+
+// Each module's kernel binder, called by cpu_dispatch_init only
+void sobel_bind(isa_level level);
+void stencil_bind(isa_level level);
+void gaussian_bind(isa_level level);
+void fft_bind(isa_level level);
+
+// Name of a level as accepted by HPC_FILTER_ISA
+const char* isa_level_name(isa_level level);
+
+// Parse a level name. Returns 0 for an unknown name.
+int parse_isa_level(const char* name, isa_level* level);
+
+// Kernels for every level are compiled into one object with per-function target
+// attributes, so a generic build (no -m flags) still carries the AVX2/AVX-512 code
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ISA_X86 1
+#define ISA_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Float loops left to the vectoriser are written once as an always-inline `name_body`.
+// ISA_VARIANTS(name, (params), (args)) wraps it as name_scalar, name_avx2 and
+// name_avx512, each built for its level and with the full vectoriser cost model (-O2
+// alone only takes loops that need no remainder), and ISA_PICK(name, level) returns the
+// one for a level. Contraction into FMA is off, so every variant rounds like the scalar loop.
+#ifdef __GNUC__
+#define ISA_INLINE static inline __attribute__((always_inline))
+#define ISA_VEC \
+    __attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic", "fp-contract=off")))
+#else
+#define ISA_INLINE static inline
+#define ISA_VEC
+#endif
+
+#ifdef ISA_X86
+#define ISA_VARIANTS(name, params, args)                                                \
+    ISA_VEC static void name##_scalar params { name##_body args; }                      \
+    ISA_VEC ISA_TARGET("avx2") static void name##_avx2 params { name##_body args; }     \
+    ISA_VEC ISA_TARGET("avx512f") static void name##_avx512 params { name##_body args; }
+#define ISA_PICK(name, level) ((level) >= ISA_AVX512 ? name##_avx512 : \
+                               (level) >= ISA_AVX2 ? name##_avx2 : name##_scalar)
+#else
+#define ISA_VARIANTS(name, params, args) \
+    ISA_VEC static void name##_scalar params { name##_body args; }
+#define ISA_PICK(name, level) ((void)(level), name##_scalar)
+#endif
+
+#endif
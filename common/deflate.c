@@ -0,0 +1,500 @@
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+
+#define WINDOW 32768
+#define WMASK (WINDOW - 1)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define BLOCK_SYMBOLS 32768   // symbols per block before its codes are rebuilt
+#define MAX_BITS 15           // longest literal/length and distance code
+#define MAX_CL_BITS 7         // longest code length code
+
+// Match search per level: candidates followed per position, the match length below
+// which the next position is tried before committing (0: greedy), and the length
+// that ends the search early
+typedef struct {
+    int chain, lazy, nice;
+} level_params;
+
+static const level_params levels[DEFLATE_MAX_LEVEL + 1] = {
+    {0, 0, 0},       {4, 0, 16},      {8, 0, 32},      {16, 0, 64},     {16, 8, 64},
+    {32, 16, 128},   {128, 32, 258},  {256, 64, 258},  {1024, 128, 258}, {4096, 258, 258},
+};
+
+static const unsigned short len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+    13, 13};
+static const unsigned char cl_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static int floor_log2(unsigned x) {
+    int b = 0;
+    while (x >>= 1) b++;
+    return b;
+}
+
+// Length code (0..28, symbol 257 + code) of a match of `len` bytes
+static int len_code(int len) {
+    unsigned x = (unsigned)(len - MIN_MATCH);
+    if (len == MAX_MATCH) return 28;
+    if (x < 8) return (int)x;
+    int b = floor_log2(x);
+    return 4 * (b - 1) + (int)((x >> (b - 2)) & 3);
+}
+
+// Distance code (0..29) of a match `dist` bytes back
+static int dist_code(int dist) {
+    unsigned x = (unsigned)(dist - 1);
+    if (x < 4) return (int)x;
+    int b = floor_log2(x);
+    return 2 * b + (int)((x >> (b - 1)) & 1);
+}
+
+// Bits go out least significant first; Huffman codes are stored bit-reversed to match
+typedef struct {
+    unsigned char* out;
+    size_t pos;
+    uint64_t bits;
+    int count;
+} bit_writer;
+
+static void put_bits(bit_writer* w, uint32_t value, int n) {
+    w->bits |= (uint64_t)value << w->count;
+    w->count += n;
+    while (w->count >= 8) {
+        w->out[w->pos++] = (unsigned char)w->bits;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+static void align_byte(bit_writer* w) {
+    if (w->count > 0) put_bits(w, 0, 8 - w->count);
+}
+
+// Code lengths of at most `limit` bits for the `n` symbols with counts `freq`. Builds
+// a Huffman tree over the used symbols, then, if it is too deep, moves codes up from
+// the deepest level until the lengths fit and still form a complete code. At least two
+// symbols always get codes, as some decoders reject a one-code tree.
+static void huffman_lengths(const uint32_t* freq, int n, int limit, unsigned char* len) {
+    int sym[288], used = 0;
+    uint64_t weight[2 * 288];
+    int parent[2 * 288];
+    memset(len, 0, (size_t)n);
+    for (int i = 0; i < n; i++)
+        if (freq[i]) sym[used++] = i;
+    for (int i = 0; used < 2; i++) {
+        if (!freq[i] && (used == 0 || sym[0] != i)) sym[used++] = i;
+    }
+    // leaves by increasing count (insertion sort: at most 288 symbols)
+    for (int i = 1; i < used; i++) {
+        int s = sym[i], j = i;
+        while (j > 0 && freq[sym[j - 1]] > freq[s]) {
+            sym[j] = sym[j - 1];
+            j--;
+        }
+        sym[j] = s;
+    }
+    for (int i = 0; i < used; i++) weight[i] = freq[sym[i]] ? freq[sym[i]] : 1;
+
+    // two-queue merge: internal nodes are made in order of weight
+    int leaf = 0, node = used, next = used;
+    for (int k = 0; k < used - 1; k++) {
+        int pick[2];
+        for (int j = 0; j < 2; j++) {
+            if (leaf < used && (node >= next || weight[leaf] <= weight[node])) pick[j] = leaf++;
+            else pick[j] = node++;
+        }
+        weight[next] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next;
+        next++;
+    }
+    int root = next - 1, count[MAX_BITS * 2 + 2] = {0}, depth[2 * 288];
+    depth[root] = 0;
+    for (int i = root - 1; i >= 0; i--) depth[i] = depth[parent[i]] + 1;
+    int deepest = 0;
+    for (int i = 0; i < used; i++) {
+        int d = depth[i] < 2 * MAX_BITS + 1 ? depth[i] : 2 * MAX_BITS + 1;
+        count[d]++;
+        if (d > deepest) deepest = d;
+    }
+
+    // fold every level below the limit into it, then split shorter codes to restore
+    // the Kraft sum to exactly one
+    if (deepest > limit) {
+        for (int d = limit + 1; d <= deepest; d++) {
+            count[limit] += count[d];
+            count[d] = 0;
+        }
+        uint64_t total = 0;
+        for (int d = 1; d <= limit; d++) total += (uint64_t)count[d] << (limit - d);
+        while (total > (1ull << limit)) {
+            count[limit]--;
+            for (int d = limit - 1; d > 0; d--) {
+                if (count[d]) {
+                    count[d]--;
+                    count[d + 1] += 2;
+                    break;
+                }
+            }
+            total--;
+        }
+        deepest = limit;
+    }
+
+    // the most frequent symbols (last in `sym`) take the shortest codes
+    for (int d = 1, i = used - 1; d <= deepest; d++)
+        for (int c = 0; c < count[d]; c++) len[sym[i--]] = (unsigned char)d;
+}
+
+// Canonical codes for code lengths `len`, bit-reversed for put_bits
+static void huffman_codes(const unsigned char* len, int n, uint16_t* code) {
+    int count[MAX_BITS + 1] = {0}, next[MAX_BITS + 2];
+    for (int i = 0; i < n; i++) count[len[i]]++;
+    count[0] = 0;
+    next[1] = 0;
+    for (int b = 1; b <= MAX_BITS; b++) next[b + 1] = (next[b] + count[b]) << 1;
+    for (int i = 0; i < n; i++) {
+        if (!len[i]) continue;
+        unsigned c = (unsigned)next[len[i]]++, r = 0;
+        for (int b = 0; b < len[i]; b++, c >>= 1) r = (r << 1) | (c & 1);
+        code[i] = (uint16_t)r;
+    }
+}
+
+// A literal (dist 0) or a match of `len` bytes `dist` back
+typedef struct {
+    uint16_t len, dist;
+} symbol;
+
+typedef struct {
+    const unsigned char* data;   // history then input
+    size_t end;                  // input ends at data + end
+    int64_t* head;               // latest position per hash
+    int64_t* prev;               // previous position with the same hash, by position
+    symbol* syms;
+    int nsym;
+    size_t block_start;          // first input byte of the block being collected
+    uint32_t lit_freq[286], dist_freq[30];
+    bit_writer w;
+} deflate_state;
+
+static unsigned hash3(const unsigned char* p) {
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void insert(deflate_state* s, size_t pos) {
+    if (pos + MIN_MATCH > s->end) return;
+    unsigned h = hash3(s->data + pos);
+    s->prev[pos & WMASK] = s->head[h];
+    s->head[h] = (int64_t)pos;
+}
+
+// Longest earlier match for the bytes at `pos` within the window; 0 if under MIN_MATCH
+static int longest_match(const deflate_state* s, size_t pos, const level_params* lp,
+                         int* dist) {
+    size_t avail = s->end - pos;
+    int max = avail < MAX_MATCH ? (int)avail : MAX_MATCH, best = 0;
+    if (max < MIN_MATCH) return 0;
+    const unsigned char* p = s->data + pos;
+    int64_t cand = s->prev[pos & WMASK];
+    for (int chain = lp->chain; cand >= 0 && chain > 0; chain--) {
+        if ((size_t)cand + WINDOW <= pos) break;
+        const unsigned char* q = s->data + cand;
+        if (q[best] == p[best] && q[0] == p[0]) {
+            int l = 0;
+            while (l < max && q[l] == p[l]) l++;
+            if (l > best) {
+                best = l;
+                *dist = (int)(pos - (size_t)cand);
+                if (l >= lp->nice || l == max) break;
+            }
+        }
+        int64_t next = s->prev[cand & WMASK];
+        if (next >= cand) break;
+        cand = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+// Bits of the symbols under the code lengths `lit`/`dist`, extra bits included
+static uint64_t symbol_bits(const deflate_state* s, const unsigned char* lit,
+                            const unsigned char* dist) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 286; i++) {
+        bits += (uint64_t)s->lit_freq[i] * lit[i];
+        if (i > 256) bits += (uint64_t)s->lit_freq[i] * len_extra[i - 257];
+    }
+    for (int i = 0; i < 30; i++) bits += (uint64_t)s->dist_freq[i] * (dist[i] + dist_extra[i]);
+    return bits;
+}
+
+static void write_symbols(deflate_state* s, const uint16_t* lcode, const unsigned char* llen,
+                          const uint16_t* dcode, const unsigned char* dlen) {
+    bit_writer* w = &s->w;
+    for (int i = 0; i < s->nsym; i++) {
+        symbol y = s->syms[i];
+        if (!y.dist) {
+            put_bits(w, lcode[y.len], llen[y.len]);
+            continue;
+        }
+        int lc = len_code(y.len), dc = dist_code(y.dist);
+        put_bits(w, lcode[257 + lc], llen[257 + lc]);
+        put_bits(w, (uint32_t)(y.len - len_base[lc]), len_extra[lc]);
+        put_bits(w, dcode[dc], dlen[dc]);
+        put_bits(w, (uint32_t)(y.dist - dist_base[dc]), dist_extra[dc]);
+    }
+    put_bits(w, lcode[256], llen[256]);
+}
+
+static void write_stored(bit_writer* w, const unsigned char* p, size_t n, int final) {
+    do {
+        size_t k = n < 65535 ? n : 65535;
+        put_bits(w, final && k == n, 3);
+        align_byte(w);
+        unsigned char* o = w->out + w->pos;
+        o[0] = (unsigned char)k;
+        o[1] = (unsigned char)(k >> 8);
+        o[2] = (unsigned char)~k;
+        o[3] = (unsigned char)(~k >> 8);
+        memcpy(o + 4, p, k);
+        w->pos += 4 + k;
+        p += k;
+        n -= k;
+    } while (n > 0);
+}
+
+// Emit the collected symbols, input [block_start, pos), as whichever of a dynamic,
+// fixed or stored block is smallest
+static void write_block(deflate_state* s, size_t pos, int final) {
+    s->lit_freq[256]++;
+    unsigned char llen[286], dlen[30], flen[288], fdlen[30];
+    huffman_lengths(s->lit_freq, 286, MAX_BITS, llen);
+    huffman_lengths(s->dist_freq, 30, MAX_BITS, dlen);
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && !llen[hlit - 1]) hlit--;
+    while (hdist > 1 && !dlen[hdist - 1]) hdist--;
+
+    // code lengths of both trees, run-length coded with symbols 16 to 18
+    unsigned char lens[286 + 30], rle[286 + 30], rle_extra[286 + 30];
+    int total = hlit + hdist, nrle = 0;
+    memcpy(lens, llen, (size_t)hlit);
+    memcpy(lens + hlit, dlen, (size_t)hdist);
+    uint32_t cl_freq[19] = {0};
+    for (int i = 0; i < total;) {
+        int v = lens[i], run = 1;
+        while (i + run < total && lens[i + run] == v) run++;
+        i += run;
+        if (v == 0) {
+            while (run >= 11) {
+                int r = run < 138 ? run : 138;
+                rle[nrle] = 18, rle_extra[nrle++] = (unsigned char)(r - 11);
+                run -= r;
+            }
+            if (run >= 3) {
+                rle[nrle] = 17, rle_extra[nrle++] = (unsigned char)(run - 3);
+                run = 0;
+            }
+        } else {
+            rle[nrle] = (unsigned char)v, rle_extra[nrle++] = 0;
+            run--;
+            while (run >= 3) {
+                int r = run < 6 ? run : 6;
+                rle[nrle] = 16, rle_extra[nrle++] = (unsigned char)(r - 3);
+                run -= r;
+            }
+        }
+        while (run-- > 0) rle[nrle] = (unsigned char)v, rle_extra[nrle++] = 0;
+    }
+    for (int i = 0; i < nrle; i++) cl_freq[rle[i]]++;
+    unsigned char cl_len[19];
+    huffman_lengths(cl_freq, 19, MAX_CL_BITS, cl_len);
+    int hclen = 19;
+    while (hclen > 4 && !cl_len[cl_order[hclen - 1]]) hclen--;
+
+    for (int i = 0; i < 288; i++) flen[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    memset(fdlen, 5, sizeof(fdlen));
+    uint64_t dyn_bits = 17 + 3 * (uint64_t)hclen + symbol_bits(s, llen, dlen);
+    for (int i = 0; i < 19; i++) dyn_bits += (uint64_t)cl_freq[i] * cl_len[i];
+    for (int i = 0; i < nrle; i++)
+        dyn_bits += rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : rle[i] == 18 ? 7 : 0;
+    uint64_t fixed_bits = 3 + symbol_bits(s, flen, fdlen);
+    size_t raw = pos - s->block_start;
+    uint64_t stored_bits = ((uint64_t)raw + 5 * (raw / 65535 + 1)) * 8 + 7;
+
+    bit_writer* w = &s->w;
+    if (stored_bits <= dyn_bits && stored_bits <= fixed_bits) {
+        write_stored(w, s->data + s->block_start, raw, final);
+    } else if (fixed_bits <= dyn_bits) {
+        uint16_t lcode[288], dcode[30];
+        huffman_codes(flen, 288, lcode);
+        huffman_codes(fdlen, 30, dcode);
+        put_bits(w, (uint32_t)final | 1u << 1, 3);
+        write_symbols(s, lcode, flen, dcode, fdlen);
+    } else {
+        uint16_t lcode[286], dcode[30], cl_code[19];
+        huffman_codes(llen, 286, lcode);
+        huffman_codes(dlen, 30, dcode);
+        huffman_codes(cl_len, 19, cl_code);
+        put_bits(w, (uint32_t)final | 2u << 1, 3);
+        put_bits(w, (uint32_t)(hlit - 257), 5);
+        put_bits(w, (uint32_t)(hdist - 1), 5);
+        put_bits(w, (uint32_t)(hclen - 4), 4);
+        for (int i = 0; i < hclen; i++) put_bits(w, cl_len[cl_order[i]], 3);
+        for (int i = 0; i < nrle; i++) {
+            put_bits(w, cl_code[rle[i]], cl_len[rle[i]]);
+            if (rle[i] >= 16) put_bits(w, rle_extra[i], rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : 7);
+        }
+        write_symbols(s, lcode, llen, dcode, dlen);
+    }
+
+    memset(s->lit_freq, 0, sizeof(s->lit_freq));
+    memset(s->dist_freq, 0, sizeof(s->dist_freq));
+    s->nsym = 0;
+    s->block_start = pos;
+}
+
+static void emit_literal(deflate_state* s, size_t pos) {
+    unsigned char c = s->data[pos];
+    s->syms[s->nsym++] = (symbol){ c, 0 };
+    s->lit_freq[c]++;
+    if (s->nsym == BLOCK_SYMBOLS) write_block(s, pos + 1, 0);
+}
+
+static void emit_match(deflate_state* s, size_t pos, int len, int dist) {
+    s->syms[s->nsym++] = (symbol){ (uint16_t)len, (uint16_t)dist };
+    s->lit_freq[257 + len_code(len)]++;
+    s->dist_freq[dist_code(dist)]++;
+    if (s->nsym == BLOCK_SYMBOLS) write_block(s, pos + (size_t)len, 0);
+}
+
+size_t deflate_bound(size_t n) {
+    return n + 5 * (n / 16384 + 2) + 16;
+}
+
+size_t deflate_piece(const unsigned char* src, size_t n, size_t history, int level, int last,
+                     unsigned char* dst) {
+    if (level < 0) level = 0;
+    if (level > DEFLATE_MAX_LEVEL) level = DEFLATE_MAX_LEVEL;
+    bit_writer w = { dst, 0, 0, 0 };
+
+    if (level == 0) {
+        if (n > 0 || last) write_stored(&w, src, n, last);
+    } else {
+        if (history > WINDOW) history = WINDOW;
+        deflate_state s;
+        memset(&s, 0, sizeof(s));
+        s.data = src - history;
+        s.end = history + n;
+        s.head = malloc(HASH_SIZE * sizeof(int64_t));
+        s.prev = malloc(WINDOW * sizeof(int64_t));
+        s.syms = malloc(BLOCK_SYMBOLS * sizeof(symbol));
+        if (!s.head || !s.prev || !s.syms) {
+            free(s.head);
+            free(s.prev);
+            free(s.syms);
+            return 0;
+        }
+        memset(s.head, 0xff, HASH_SIZE * sizeof(int64_t));   // -1: no position yet
+        memset(s.prev, 0xff, WINDOW * sizeof(int64_t));
+        s.block_start = history;
+        s.w = w;
+        for (size_t p = 0; p < history; p++) insert(&s, p);
+
+        // lazy matching as in zlib: a match is held back one position in case the
+        // next one starts a longer match
+        const level_params* lp = &levels[level];
+        size_t pos = history;
+        int prev_len = 0, prev_dist = 0, pending = 0;
+        while (pos < s.end) {
+            insert(&s, pos);
+            int dist = 0, len = 0;
+            if (!lp->lazy || prev_len < lp->lazy) len = longest_match(&s, pos, lp, &dist);
+            if (!lp->lazy) {
+                if (len) {
+                    emit_match(&s, pos, len, dist);
+                    for (size_t p = pos + 1; p < pos + (size_t)len; p++) insert(&s, p);
+                    pos += (size_t)len;
+                } else {
+                    emit_literal(&s, pos++);
+                }
+            } else if (prev_len && len <= prev_len) {
+                emit_match(&s, pos - 1, prev_len, prev_dist);
+                for (size_t p = pos + 1; p < pos - 1 + (size_t)prev_len; p++) insert(&s, p);
+                pos += (size_t)prev_len - 1;
+                pending = 0;
+                prev_len = 0;
+            } else {
+                if (pending) emit_literal(&s, pos - 1);
+                pending = 1;
+                prev_len = len;
+                prev_dist = dist;
+                pos++;
+            }
+        }
+        if (pending) emit_literal(&s, pos - 1);
+        if (s.nsym > 0 || last) write_block(&s, s.end, last);
+        w = s.w;
+        free(s.head);
+        free(s.prev);
+        free(s.syms);
+    }
+
+    // an empty stored block ends a piece on a byte boundary with nothing pending
+    if (!last) {
+        put_bits(&w, 0, 3);
+        align_byte(&w);
+        memcpy(w.out + w.pos, "\0\0\xff\xff", 4);
+        w.pos += 4;
+    } else {
+        align_byte(&w);
+    }
+    return w.pos;
+}
+
+void zlib_header(int level, unsigned char* dst) {
+    // 32 KB window, deflate; FLEVEL is only a hint, and the check bits make the pair a
+    // multiple of 31
+    int flevel = level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3;
+    dst[0] = 0x78;
+    dst[1] = (unsigned char)(flevel << 6);
+    dst[1] = (unsigned char)(dst[1] + 31 - (dst[0] * 256 + dst[1]) % 31);
+}
+
+#define ADLER_BASE 65521u
+#define ADLER_NMAX 5552   // most bytes before the sums must be reduced
+
+uint32_t adler32_update(uint32_t adler, const unsigned char* p, size_t n) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (n > 0) {
+        size_t k = n < ADLER_NMAX ? n : ADLER_NMAX;
+        n -= k;
+        while (k--) {
+            a += *p++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return b << 16 | a;
+}
+
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2) {
+    uint64_t rem = len2 % ADLER_BASE;
+    uint64_t a1 = adler1 & 0xffff, b1 = adler1 >> 16, a2 = adler2 & 0xffff, b2 = adler2 >> 16;
+    uint64_t a = (a1 + a2 + ADLER_BASE - 1) % ADLER_BASE;
+    uint64_t b = (rem * a1 + b1 + b2 + ADLER_BASE - rem) % ADLER_BASE;
+    return (uint32_t)(b << 16 | a);
+}
@@ -0,0 +1,37 @@
+// deflate.h
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw deflate (RFC 1951) encoder for streams compressed in independent pieces, as the
+// PNG encoders split an image across ranks or threads: each piece is a whole number of
+// blocks, may use the bytes just before it as its dictionary, and ends on a byte
+// boundary, so the pieces simply concatenate into one stream.
+
+// Levels: 0 stores, 1 is fastest, 9 searches hardest
+#define DEFLATE_MAX_LEVEL 9
+#define DEFLATE_DEFAULT_LEVEL 6
+
+// Most bytes deflate_piece writes for `n` input bytes at any level
+size_t deflate_bound(size_t n);
+
+// Compress `n` bytes at `src` into `dst` (deflate_bound bytes). The `history` bytes
+// before `src`, which precede it in the stream, prime the match window (only the last
+// 32 KB matter). A piece that is not `last` ends with an empty stored block, which
+// aligns it to a byte; the last piece's final block ends the stream. Returns the
+// compressed size, or 0 if the match tables cannot be allocated.
+size_t deflate_piece(const unsigned char* src, size_t n, size_t history, int level, int last,
+                     unsigned char* dst);
+
+// The two bytes that start a zlib (RFC 1950) stream of deflate data at `level`
+void zlib_header(int level, unsigned char* dst);
+
+// Adler-32 of `n` more bytes after `adler` (1 for an empty stream)
+uint32_t adler32_update(uint32_t adler, const unsigned char* p, size_t n);
+
+// Adler-32 of two streams back to back, from each one's checksum and the second's length
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
+
+#endif
@@ -0,0 +1,251 @@
+#include <math.h>
+#include <stdlib.h>
+#include "fft.h"
+#include "cpu_dispatch.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// One stage of butterflies over `half` pairs (a[k], b[k]), `stride` floats apart, with
+// the stage's twiddles in a row. The pairs never overlap, so the halves can be restrict.
+ISA_INLINE void butterfly_span(float* restrict ar, float* restrict ai, float* restrict br,
+                               float* restrict bi, long stride, int half,
+                               const float* restrict cos_t, const float* restrict sin_t,
+                               float sign) {
+    for (int k = 0; k < half; k++) {
+        float wr = cos_t[k], wi = sign * sin_t[k];
+        long i = k * stride;
+        float xr = br[i] * wr - bi[i] * wi;
+        float xi = br[i] * wi + bi[i] * wr;
+        br[i] = ar[i] - xr; bi[i] = ai[i] - xi;
+        ar[i] += xr;        ai[i] += xi;
+    }
+}
+
+// iterative Cooley–Tukey butterflies
+ISA_INLINE void stages(const fft_plan* plan, float* re, float* im, long stride, float sign) {
+    int n = plan->n;
+    for (int half = 1; half < n; half <<= 1) {
+        const float* cos_t = plan->cos_t + half - 1;
+        const float* sin_t = plan->sin_t + half - 1;
+        for (int base = 0; base < n; base += 2 * half) {
+            long a = base * stride, b = (base + half) * stride;
+            butterfly_span(re + a, im + a, re + b, im + b, stride, half, cos_t, sin_t, sign);
+        }
+    }
+}
+
+// The rows of fft_2d are contiguous, so stride 1 gets its own copy that vectorises
+ISA_INLINE void butterflies_body(const fft_plan* plan, float* re, float* im, long stride,
+                                 float sign) {
+    if (stride == 1) stages(plan, re, im, 1, sign);
+    else stages(plan, re, im, stride, sign);
+}
+
+ISA_VARIANTS(butterflies, (const fft_plan* plan, float* re, float* im, long stride, float sign),
+             (plan, re, im, stride, sign))
+
+typedef void (*butterflies_fn)(const fft_plan* plan, float* re, float* im, long stride,
+                               float sign);
+
+static butterflies_fn butterflies;
+
+void fft_bind(isa_level level) {
+    butterflies = ISA_PICK(butterflies, level);
+}
+
+int fft_plan_init(fft_plan* plan, int n) {
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+    if (n < 2 || (1 << bits) != n) return 0;
+    cpu_dispatch_init();
+
+    plan->n = n;
+    plan->cos_t = malloc((n - 1) * sizeof(float));
+    plan->sin_t = malloc((n - 1) * sizeof(float));
+    plan->rev = malloc(n * sizeof(int));
+    if (!plan->cos_t || !plan->sin_t || !plan->rev) {
+        fft_plan_free(plan);
+        return 0;
+    }
+
+    for (int half = 1; half < n; half <<= 1) {
+        int step = n / (2 * half);
+        for (int k = 0; k < half; k++) {
+            plan->cos_t[half - 1 + k] = (float)cos(2.0 * M_PI * (k * step) / n);
+            plan->sin_t[half - 1 + k] = (float)sin(2.0 * M_PI * (k * step) / n);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++)
+            if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        plan->rev[i] = r;
+    }
+    return 1;
+}
+
+void fft_plan_free(fft_plan* plan) {
+    free(plan->cos_t);
+    free(plan->sin_t);
+    free(plan->rev);
+    plan->cos_t = plan->sin_t = NULL;
+    plan->rev = NULL;
+}
+
+void fft_1d(const fft_plan* plan, float* re, float* im, long stride, int inverse) {
+    int n = plan->n;
+
+    for (int i = 0; i < n; i++) {
+        int j = plan->rev[i];
+        if (j > i) {
+            float t = re[i * stride]; re[i * stride] = re[j * stride]; re[j * stride] = t;
+            t = im[i * stride]; im[i * stride] = im[j * stride]; im[j * stride] = t;
+        }
+    }
+    butterflies(plan, re, im, stride, inverse ? 1.0f : -1.0f);
+}
+
+// In-place transpose of an n x n array, in cache-sized blocks
+static void transpose(float* a, int n) {
+    const int B = 32;
+    for (int by = 0; by < n; by += B)
+        for (int bx = by; bx < n; bx += B)
+            for (int y = by; y < by + B && y < n; y++)
+                for (int x = (bx == by ? y + 1 : bx); x < bx + B && x < n; x++) {
+                    float t = a[(long)y * n + x];
+                    a[(long)y * n + x] = a[(long)x * n + y];
+                    a[(long)x * n + y] = t;
+                }
+}
+
+void fft_2d(const fft_plan* plan, float* re, float* im, int inverse) {
+    int n = plan->n;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int y = 0; y < n; y++)
+            fft_1d(plan, re + (long)y * n, im + (long)y * n, 1, inverse);
+        if (pass == 0) {
+            transpose(re, n);
+            transpose(im, n);
+        }
+    }
+}
+
+int fft_size(int radius, int width, int rows) {
+    int best = 0;
+    double best_cost = 0.0;
+    for (int n = 16; n <= FFT_MAX_SIZE; n <<= 1) {
+        int tile = n - 2 * radius;
+        if (tile < 1) continue;
+        double tiles = (double)((width + tile - 1) / tile) * ((rows + tile - 1) / tile);
+        double cost = tiles * n * n * log2(n);
+        if (!best || cost < best_cost) {
+            best = n;
+            best_cost = cost;
+        }
+        if (tile >= width && tile >= rows) break;  // a single tile already covers everything
+    }
+    return best;
+}
+
+static unsigned char to_pixel(float v) {
+    int i = (int)(v + 0.5f);
+    return (unsigned char)((i < 0) ? 0 : ((i > 255) ? 255 : i));
+}
+
+int fft_convolve(const padded_image* in, const float* kernel, int radius, const image_view* out) {
+    int width = in->width, rows = in->rows;
+    int n = fft_size(radius, width, rows);
+    if (!n) return 0;
+    int tile = n - 2 * radius;
+    long area = (long)n * n;
+
+    fft_plan plan;
+    if (!fft_plan_init(&plan, n)) return 0;
+
+    // kernel spectrum, flipped so the circular convolution is a correlation
+    float* kre = calloc(area, sizeof(float));
+    float* kim = calloc(area, sizeof(float));
+    if (!kre || !kim) {
+        free(kre); free(kim);
+        fft_plan_free(&plan);
+        return 0;
+    }
+    int ksize = 2 * radius + 1;
+    for (int ky = -radius; ky <= radius; ky++)
+        for (int kx = -radius; kx <= radius; kx++)
+            kre[(long)((n - ky) % n) * n + (n - kx) % n] = kernel[(ky + radius) * ksize + (kx + radius)];
+    fft_2d(&plan, kre, kim, 0);
+
+    int tiles_x = (width + tile - 1) / tile, tiles_y = (rows + tile - 1) / tile;
+    int ok = 1;
+
+    #pragma omp parallel
+    {
+        // (R + iG) and (B + 0i) per tile
+        float* buf = malloc(4 * area * sizeof(float));
+        if (!buf) {
+            #pragma omp atomic write
+            ok = 0;
+        }
+        float *are = buf, *aim = buf + area, *bre = buf + 2 * area, *bim = buf + 3 * area;
+
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                if (!buf) continue;
+                int oy = ty * tile, ox = tx * tile;
+
+                // tile plus an r-pixel apron straight from the ghost border. Samples past
+                // the border only feed outputs beyond the strip, so they just repeat its edge.
+                for (int j = 0; j < n; j++) {
+                    int sy = oy - radius + j;
+                    if (sy > rows + radius - 1) sy = rows + radius - 1;
+                    const unsigned char* src = PADDED_AT(in, 0, sy);
+                    float *ar = are + (long)j * n, *ai = aim + (long)j * n;
+                    float *br = bre + (long)j * n, *bi = bim + (long)j * n;
+                    for (int i = 0; i < n; i++) {
+                        int sx = ox - radius + i;
+                        const unsigned char* p = src + (sx < width + radius ? sx : width + radius - 1) * 3;
+                        ar[i] = p[0]; ai[i] = p[1];
+                        br[i] = p[2]; bi[i] = 0.0f;
+                    }
+                }
+
+                fft_2d(&plan, are, aim, 0);
+                fft_2d(&plan, bre, bim, 0);
+                for (long i = 0; i < area; i++) {
+                    float r = are[i] * kre[i] - aim[i] * kim[i];
+                    aim[i] = are[i] * kim[i] + aim[i] * kre[i];
+                    are[i] = r;
+                    r = bre[i] * kre[i] - bim[i] * kim[i];
+                    bim[i] = bre[i] * kim[i] + bim[i] * kre[i];
+                    bre[i] = r;
+                }
+                fft_2d(&plan, are, aim, 1);
+                fft_2d(&plan, bre, bim, 1);
+
+                // only the centre tile x tile block is free of wrap-around
+                float scale = 1.0f / (float)area;
+                int h = (oy + tile > rows) ? rows - oy : tile;
+                int w = (ox + tile > width) ? width - ox : tile;
+                for (int j = 0; j < h; j++) {
+                    unsigned char* dst = VIEW_ROW(out, oy + j) + ox * 3;
+                    long row = (long)(j + radius) * n + radius;
+                    for (int i = 0; i < w; i++) {
+                        dst[i * 3]     = to_pixel(are[row + i] * scale);
+                        dst[i * 3 + 1] = to_pixel(aim[row + i] * scale);
+                        dst[i * 3 + 2] = to_pixel(bre[row + i] * scale);
+                    }
+                }
+            }
+        }
+        free(buf);
+    }
+
+    free(kre);
+    free(kim);
+    fft_plan_free(&plan);
+    return ok;
+}
@@ -0,0 +1,45 @@
+// fft.h
+#ifndef FFT_H
+#define FFT_H
+
+#include "border.h"
+
+// Precomputed twiddles and bit-reversal table for a power-of-two transform size
+typedef struct {
+    int n;
+    float* cos_t;   // n - 1 entries, stage by stage: the stage of half-length h
+    float* sin_t;   // starts at h - 1 and holds angles 2*pi*k/(2h), k < h
+    int* rev;       // bit-reversed index of each position
+} fft_plan;
+
+// Returns 0 if n is not a power of two or on allocation failure
+int fft_plan_init(fft_plan* plan, int n);
+void fft_plan_free(fft_plan* plan);
+
+// In-place radix-2 complex FFT of n samples spaced `stride` floats apart.
+// The inverse is unscaled (callers divide by n).
+void fft_1d(const fft_plan* plan, float* re, float* im, long stride, int inverse);
+
+// In-place 2D FFT of an n x n row-major complex array as rows, transpose, rows.
+// The forward result is left transposed; the inverse of a transposed spectrum comes
+// back in the original layout, so pointwise products need no extra transposes.
+void fft_2d(const fft_plan* plan, float* re, float* im, int inverse);
+
+// Largest transform fft_convolve runs, and so the largest kernel radius it takes: a tile
+// must keep at least one output row and column inside the 2r ghost border
+#define FFT_MAX_SIZE 4096
+#define FFT_MAX_RADIUS ((FFT_MAX_SIZE - 1) / 2)
+
+// Transform size fft_convolve uses: the power of two up to FFT_MAX_SIZE that minimises
+// total FFT work over the overlap-save tiles (n - 2r square) covering a width x rows
+// region. Returns 0 when the radius is over FFT_MAX_RADIUS.
+int fft_size(int radius, int width, int rows);
+
+// Correlate every row of a padded strip (pad >= r) with a (2r+1)^2 kernel, exactly like
+// the direct loops (sum of in[y+ky][x+kx] * kernel[ky][kx], ghost border included).
+// The strip is cut into overlap-save tiles that are transformed independently across
+// threads; two real channels share one complex transform. `out` receives `in->rows` rows.
+// Returns 0 on allocation failure.
+int fft_convolve(const padded_image* in, const float* kernel, int radius, const image_view* out);
+
+#endif
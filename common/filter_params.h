@@ -0,0 +1,46 @@
+// filter_params.h
+#ifndef FILTER_PARAMS_H
+#define FILTER_PARAMS_H
+
+// The parameter enums of the public API (hpcfilter.h), apart from the internal headers
+// so that including the API pulls in nothing else
+
+// How taps that fall outside the image are mapped back inside. Every filter and
+// backend uses these definitions; clamp is the default everywhere.
+typedef enum {
+    BORDER_CLAMP,     // repeat the edge pixel
+    BORDER_REFLECT,   // mirror about the edge pixel (edge not repeated)
+    BORDER_WRAP,      // tile the image periodically
+    BORDER_CONSTANT   // a fixed value outside the image
+} border_mode;
+
+// How the Gaussian is evaluated
+typedef enum {
+    GAUSSIAN_FIR,   // exact truncated kernel, applied separably: O(sigma) per pixel
+    GAUSSIAN_IIR,   // Young–van Vliet recursive approximation: O(1) per pixel
+    GAUSSIAN_BOX,   // single box of matching variance from a summed-area table: O(1)
+    GAUSSIAN_BOX3,  // 3-box cascade approximating the Gaussian: O(1)
+    GAUSSIAN_FFT    // exact 2D kernel applied by FFT on overlap-save tiles
+} gaussian_method;
+
+// Parse "clamp", "reflect", "wrap" or "constant". Returns 0 for an unknown name.
+int parse_border_mode(const char* name, border_mode* mode);
+
+// Name of a mode as accepted by parse_border_mode
+const char* border_mode_name(border_mode mode);
+
+// Parse "fir", "iir", "box", "box3" or "fft" into a method. Returns 0 for an unknown name.
+int parse_gaussian_method(const char* name, gaussian_method* method);
+
+// Name of a method as accepted by parse_gaussian_method
+const char* gaussian_method_name(gaussian_method method);
+
+// Whether a method implements a border mode. The box methods read their sums from a
+// table over the clamped image and support only BORDER_CLAMP; the rest support every mode.
+int gaussian_border_supported(gaussian_method method, border_mode border);
+
+// Whether a method takes a sigma. fft transforms its whole kernel at once, so its kernel
+// radius is bounded (FFT_MAX_RADIUS in fft.h); the other methods take any sigma.
+int gaussian_sigma_supported(gaussian_method method, float sigma);
+
+#endif
@@ -0,0 +1,49 @@
+// gaussian.h
+#ifndef GAUSSIAN_H
+#define GAUSSIAN_H
+
+#include "border.h"
+
+// 1D Gaussian function
+float gaussian_1d(float x, float sigma);
+
+// Kernel radius for a given sigma: ceil(3*sigma). Also the halo depth a strip needs.
+int gaussian_radius(float sigma);
+
+// Build a normalised 1D Gaussian kernel of 2*radius+1 taps, radius = ceil(3*sigma).
+// The 2D kernel used by the filters is the outer product of this kernel with itself.
+float* gaussian_kernel_1d(float sigma, int* radius);
+
+// Normalised (2r+1)^2 2D Gaussian kernel, the outer product of gaussian_kernel_1d
+float* gaussian_kernel_2d(float sigma, int* radius);
+
+// Separable Gaussian blur of every row of a padded strip (pad >= radius).
+// Runs a horizontal pass into a float buffer followed by a vertical pass, so the
+// cost per pixel is O(radius). `out` receives `in->rows` rows.
+// Returns 0 on allocation failure, 1 on success.
+int gaussian_blur_separable(const padded_image* in, const float* kernel, int radius,
+                            const image_view* out);
+
+// Recursive (Young–van Vliet) Gaussian of every row of a padded strip, cost independent
+// of sigma. Each row and column is extended by ceil(3*sigma) ghost samples to warm up
+// the recursions, so the strip needs pad >= gaussian_radius(sigma).
+// Measured against the exact FIR kernel on the sample inputs: for sigma >= 8 the
+// output is within 4 grey levels (RMS < 1); for 3 <= sigma < 8 within 7 levels
+// (RMS < 1). Below sigma = 3 the q(sigma) fit degrades (up to ~20 levels at sharp
+// edges), so use FIR there. Sigmas below 0.5 are treated as 0.5.
+int gaussian_blur_iir(const padded_image* in, float sigma, const image_view* out);
+
+// Halo rows a strip needs above and below for the chosen method
+int gaussian_halo(float sigma, gaussian_method method);
+
+// Blur rows [y0, y0 + rows) of `img` into rows [0, rows) of `out`. The strip is copied once into a
+// padded_image of radius ceil(3*sigma) under `border` (BORDER_CONSTANT pads with black),
+// then FIR, IIR and FFT read their taps straight from it. FIR switches to the FFT path
+// once the 2D kernel area passes FFT_CROSSOVER_AREA, unless the radius is over
+// FFT_MAX_RADIUS. The box methods take only BORDER_CLAMP, and fft only sigmas within
+// FFT_MAX_RADIUS (gaussian_sigma_supported); other combinations return 0.
+// Returns 0 on allocation failure.
+int gaussian_blur(const image_view* img, int y0, int rows, float sigma, gaussian_method method,
+                  border_mode border, const image_view* out);
+
+#endif
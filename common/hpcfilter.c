@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "hpcfilter.h"
+#include "gaussian.h"
+#include "sobel.h"
+#include "stencil.h"
+
+hpc_smooth_params hpc_smooth_defaults(void) {
+    hpc_smooth_params p = { 0.85f, GAUSSIAN_FIR, BORDER_CLAMP };
+    return p;
+}
+
+hpc_exec_ctx hpc_exec_defaults(void) {
+    hpc_exec_ctx e = { 0, 0, 0 };
+    return e;
+}
+
+// Resolve the row range of a call and check both views can hold it
+static int resolve_rows(const image_view* in, const image_view* out, const hpc_exec_ctx* exec,
+                        int* y0, int* rows) {
+    if (!in || !out || !in->data || !out->data) return 0;
+    if (in->channels != 3 || out->channels != 3 || in->width < 1 || out->width != in->width) return 0;
+    if (in->stride < (size_t)in->width * 3 || out->stride < (size_t)out->width * 3) return 0;
+
+    *y0 = exec ? exec->first_row : 0;
+    *rows = (exec && exec->rows) ? exec->rows : in->height - *y0;
+    return *y0 >= 0 && *rows > 0 && *y0 + *rows <= in->height && out->height >= *rows;
+}
+
+// The thread count a call asked for is applied for its duration only
+static int enter_threads(const hpc_exec_ctx* exec) {
+#ifdef _OPENMP
+    int saved = omp_get_max_threads();
+    if (exec && exec->num_threads > 0) omp_set_num_threads(exec->num_threads);
+    return saved;
+#else
+    (void)exec;
+    return 1;
+#endif
+}
+
+static void leave_threads(int saved) {
+#ifdef _OPENMP
+    omp_set_num_threads(saved);
+#else
+    (void)saved;
+#endif
+}
+
+int hpc_filter_smooth(const image_view* in, const image_view* out,
+                      const hpc_smooth_params* params, const hpc_exec_ctx* exec) {
+    int y0, rows;
+    if (!params || params->sigma <= 0.0f || !resolve_rows(in, out, exec, &y0, &rows)) return 0;
+
+    int saved = enter_threads(exec);
+    int ok = gaussian_blur(in, y0, rows, params->sigma, params->method, params->border, out);
+    leave_threads(saved);
+    return ok;
+}
+
+int hpc_filter_sharpen(const image_view* in, const image_view* out, const hpc_exec_ctx* exec) {
+    int y0, rows;
+    if (!resolve_rows(in, out, exec, &y0, &rows)) return 0;
+    int saved = enter_threads(exec);
+    int ok = sharpen_rows(in, y0, rows, out);
+    leave_threads(saved);
+    return ok;
+}
+
+int hpc_filter_emboss(const image_view* in, const image_view* out, const hpc_exec_ctx* exec) {
+    int y0, rows;
+    if (!resolve_rows(in, out, exec, &y0, &rows)) return 0;
+    int saved = enter_threads(exec);
+    int ok = emboss_rows(in, y0, rows, out);
+    leave_threads(saved);
+    return ok;
+}
+
+int hpc_filter_edges(const image_view* in, const image_view* out, const hpc_exec_ctx* exec) {
+    int y0, rows;
+    if (!resolve_rows(in, out, exec, &y0, &rows)) return 0;
+    int saved = enter_threads(exec);
+    int ok = sobel_rows(in, y0, rows, out);
+    leave_threads(saved);
+    return ok;
+}
+
+int hpc_filter_run(hpc_filter_kind kind, const image_view* in, const image_view* out,
+                   const hpc_smooth_params* smooth, const hpc_exec_ctx* exec) {
+    switch (kind) {
+    case HPC_FILTER_EDGES:   return hpc_filter_edges(in, out, exec);
+    case HPC_FILTER_EMBOSS:  return hpc_filter_emboss(in, out, exec);
+    case HPC_FILTER_SHARPEN: return hpc_filter_sharpen(in, out, exec);
+    case HPC_FILTER_SMOOTH:  return hpc_filter_smooth(in, out, smooth, exec);
+    }
+    return 0;
+}
+
+int hpc_filter_halo(hpc_filter_kind kind, const hpc_smooth_params* smooth) {
+    if (kind == HPC_FILTER_SMOOTH) return gaussian_halo(smooth->sigma, smooth->method);
+    return 1;  // 3x3 stencils
+}
+
+static const char* const filter_names[][2] = {
+    {"edges", "edgeDetection"},
+    {"emboss", "embossing"},
+    {"sharpen", "sharpening"},
+    {"smooth", "smoothing"},
+};
+
+int parse_hpc_filter(const char* name, hpc_filter_kind* kind) {
+    for (int i = 0; i <= HPC_FILTER_SMOOTH; i++) {
+        if (strcmp(name, filter_names[i][0]) == 0 || strcmp(name, filter_names[i][1]) == 0) {
+            *kind = (hpc_filter_kind)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* hpc_filter_name(hpc_filter_kind kind) {
+    return filter_names[kind][0];
+}
@@ -0,0 +1,68 @@
+// hpcfilter.h
+#ifndef HPCFILTER_H
+#define HPCFILTER_H
+
+// libhpcfilter: the filters behind every executable, callable in memory on image
+// views. Build it as a static or shared library from the files in common/ (see
+// README); the MPI helpers in common/*_mpi.c stay outside so the library itself
+// needs no MPI. Every call returns 1 on success and 0 on a bad argument or an
+// allocation failure.
+
+#include "image_view.h"
+#include "filter_params.h"
+
+// Bumped when a struct below changes layout or a call changes meaning
+#define HPC_FILTER_API_VERSION 2
+
+// The filters, for callers that pick one at run time
+typedef enum {
+    HPC_FILTER_EDGES,
+    HPC_FILTER_EMBOSS,
+    HPC_FILTER_SHARPEN,
+    HPC_FILTER_SMOOTH
+} hpc_filter_kind;
+
+// Gaussian smoothing parameters
+typedef struct {
+    float sigma;              // standard deviation in pixels
+    gaussian_method method;   // fir, iir, box, box3 or fft
+    border_mode border;       // box and box3 take only clamp (gaussian_border_supported)
+} hpc_smooth_params;
+
+// Where and how one call runs
+typedef struct {
+    int num_threads;          // OpenMP threads for this call, 0 keeps the caller's setting
+    int first_row, rows;      // input rows to filter into out's rows [0, rows); 0 rows = to the end
+} hpc_exec_ctx;
+
+// Defaults used by the executables: sigma 0.85, fir, clamp
+hpc_smooth_params hpc_smooth_defaults(void);
+
+// Whole image, caller's thread setting
+hpc_exec_ctx hpc_exec_defaults(void);
+
+// The filters. `in` and `out` are RGB views of the same width; `out` needs at least
+// `rows` rows. Rows outside the requested range are read as halo where the filter
+// needs them, so a strip of a larger view gives the same bytes as the whole image.
+// A NULL `exec` means hpc_exec_defaults().
+int hpc_filter_smooth(const image_view* in, const image_view* out,
+                      const hpc_smooth_params* params, const hpc_exec_ctx* exec);
+int hpc_filter_sharpen(const image_view* in, const image_view* out, const hpc_exec_ctx* exec);
+int hpc_filter_emboss(const image_view* in, const image_view* out, const hpc_exec_ctx* exec);
+int hpc_filter_edges(const image_view* in, const image_view* out, const hpc_exec_ctx* exec);
+
+// Run the filter of the given kind; `smooth` is only read for HPC_FILTER_SMOOTH
+int hpc_filter_run(hpc_filter_kind kind, const image_view* in, const image_view* out,
+                   const hpc_smooth_params* smooth, const hpc_exec_ctx* exec);
+
+// Rows of input a strip needs above and below its own rows for this filter
+int hpc_filter_halo(hpc_filter_kind kind, const hpc_smooth_params* smooth);
+
+// Parse "edges", "emboss", "sharpen" or "smooth" (or the executable names edgeDetection,
+// embossing, sharpening, smoothing). Returns 0 for an unknown name.
+int parse_hpc_filter(const char* name, hpc_filter_kind* kind);
+
+// Name of a filter as accepted by parse_hpc_filter
+const char* hpc_filter_name(hpc_filter_kind kind);
+
+#endif
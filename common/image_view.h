@@ -0,0 +1,33 @@
+// image_view.h
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <stddef.h>
+
+// A window onto interleaved 8-bit pixels whose rows are `stride` bytes apart. The
+// filters in common/ read and write through views, so a crop, a strip of a larger
+// image or a padded/aligned buffer is handed over as-is instead of being copied
+// into a packed width*3 buffer first. The filters expect channels == 3.
+typedef struct {
+    unsigned char* data;   // pixel (0, 0)
+    int width, height, channels;
+    size_t stride;         // bytes from one row to the next, at least width * channels
+} image_view;
+
+// View of a tightly packed RGB buffer (stride = width * 3), as stb_image returns
+static inline image_view image_view_packed(unsigned char* data, int width, int height) {
+    image_view v = { data, width, height, 3, (size_t)width * 3 };
+    return v;
+}
+
+// Sub-view of the w x h rectangle at (x, y), sharing the parent's pixels
+static inline image_view image_view_sub(const image_view* v, int x, int y, int w, int h) {
+    image_view s = { v->data + (size_t)y * v->stride + (size_t)x * v->channels,
+                     w, h, v->channels, v->stride };
+    return s;
+}
+
+// Start of row y of a view
+#define VIEW_ROW(v, y) ((v)->data + (ptrdiff_t)(y) * (ptrdiff_t)(v)->stride)
+
+#endif
@@ -0,0 +1,215 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "integral.h"
+
+// Table entries per table row
+#define ROW_LEN(sat) ((size_t)((sat)->width + 1) * 3)
+
+// Row prefix sums, then the vertical prefix as a two-level scan: every thread scans its
+// own band of rows, the band totals are chained, then each band adds its incoming total.
+#define DEFINE_BUILD(T, NAME)                                                           \
+static void NAME(T* tab, const image_view* strip) {                                     \
+    int width = strip->width, rows = strip->height;                                     \
+    size_t row_len = (size_t)(width + 1) * 3;                                           \
+    memset(tab, 0, row_len * sizeof(T));                                                \
+                                                                                        \
+    _Pragma("omp parallel for schedule(static)")                                        \
+    for (int k = 1; k <= rows; k++) {                                                   \
+        const unsigned char* src = VIEW_ROW(strip, k - 1);                              \
+        T* dst = tab + k * row_len;                                                     \
+        T r = 0, g = 0, b = 0;                                                          \
+        dst[0] = dst[1] = dst[2] = 0;                                                   \
+        for (int x = 0; x < width; x++) {                                               \
+            r += src[x * 3]; g += src[x * 3 + 1]; b += src[x * 3 + 2];                  \
+            dst[(x + 1) * 3] = r; dst[(x + 1) * 3 + 1] = g; dst[(x + 1) * 3 + 2] = b;   \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    _Pragma("omp parallel")                                                             \
+    {                                                                                   \
+        int nt = 1, t = 0;                                                              \
+        SCAN_THREADS(nt, t);                                                            \
+        int lo = 1 + (int)((long)rows * t / nt), hi = 1 + (int)((long)rows * (t + 1) / nt); \
+        for (int k = lo + 1; k < hi; k++) {                                             \
+            T* cur = tab + k * row_len;                                                 \
+            const T* prev = cur - row_len;                                              \
+            for (size_t i = 0; i < row_len; i++) cur[i] += prev[i];                     \
+        }                                                                               \
+        _Pragma("omp barrier")                                                          \
+        _Pragma("omp single")                                                           \
+        for (int band = 1; band < nt; band++) {                                         \
+            int blo = 1 + (int)((long)rows * band / nt);                                \
+            int bhi = 1 + (int)((long)rows * (band + 1) / nt);                          \
+            if (bhi == blo) continue;                                                   \
+            T* last = tab + (bhi - 1) * row_len;                                        \
+            const T* carry = tab + (blo - 1) * row_len;                                 \
+            for (size_t i = 0; i < row_len; i++) last[i] += carry[i];                   \
+        }                                                                               \
+        if (t > 0 && hi > lo) {                                                         \
+            const T* carry = tab + (lo - 1) * row_len;                                  \
+            for (int k = lo; k < hi - 1; k++) {                                         \
+                T* cur = tab + k * row_len;                                             \
+                for (size_t i = 0; i < row_len; i++) cur[i] += carry[i];                \
+            }                                                                           \
+        }                                                                               \
+    }                                                                                   \
+}
+
+#ifdef _OPENMP
+#define SCAN_THREADS(nt, t) do { nt = omp_get_num_threads(); t = omp_get_thread_num(); } while (0)
+#else
+#define SCAN_THREADS(nt, t) do { (void)nt; (void)t; } while (0)
+#endif
+
+DEFINE_BUILD(uint32_t, build_32)
+DEFINE_BUILD(uint64_t, build_64)
+
+// Box sums with clamped borders. Out-of-image taps repeat the edge row/column, so each
+// window is the in-image rectangle plus the edge rows/columns weighted by how many
+// taps fell off that side.
+#define DEFINE_BOX(T, NAME)                                                             \
+static void NAME(const integral_image* sat, int r, int y0, int rows, const image_view* out) { \
+    const T* tab = (const T*)sat->data;                                                 \
+    size_t row_len = ROW_LEN(sat);                                                      \
+    int width = sat->width, height = sat->height, f = sat->first_row;                   \
+    uint64_t area = (uint64_t)(2 * r + 1) * (2 * r + 1);                                \
+                                                                                        \
+    _Pragma("omp parallel for schedule(static)")                                        \
+    for (int y = y0; y < y0 + rows; y++) {                                              \
+        int ylo = y - r < 0 ? 0 : y - r;                                                \
+        int yhi = y + r > height - 1 ? height - 1 : y + r;                              \
+        int yseg[3][3] = {{ylo, yhi, 1}, {0, 0, r - y}, {height - 1, height - 1, y + r - (height - 1)}}; \
+        unsigned char* dst = VIEW_ROW(out, y - y0);                                     \
+        const T* top = tab + (ylo - f) * row_len;                                       \
+        const T* bot = tab + (yhi + 1 - f) * row_len;                                   \
+        int x_inner_lo = r, x_inner_hi = width - r;                                     \
+        int rows_inner = (y - r >= 0) && (y + r <= height - 1);                         \
+                                                                                        \
+        for (int x = 0; x < width; x++) {                                               \
+            if (rows_inner && x >= x_inner_lo && x < x_inner_hi) {                      \
+                const int a = (x - r) * 3, b = (x + r + 1) * 3;                         \
+                for (int c = 0; c < 3; c++) {                                           \
+                    T s = bot[b + c] - top[b + c] - bot[a + c] + top[a + c];            \
+                    dst[x * 3 + c] = (unsigned char)(((uint64_t)s + area / 2) / area);  \
+                }                                                                       \
+                continue;                                                               \
+            }                                                                           \
+            int xlo = x - r < 0 ? 0 : x - r;                                            \
+            int xhi = x + r > width - 1 ? width - 1 : x + r;                            \
+            int xseg[3][3] = {{xlo, xhi, 1}, {0, 0, r - x}, {width - 1, width - 1, x + r - (width - 1)}}; \
+            for (int c = 0; c < 3; c++) {                                               \
+                uint64_t sum = 0;                                                       \
+                for (int i = 0; i < 3; i++) {                                           \
+                    if (yseg[i][2] <= 0) continue;                                      \
+                    const T* t0 = tab + (yseg[i][0] - f) * row_len;                     \
+                    const T* t1 = tab + (yseg[i][1] + 1 - f) * row_len;                 \
+                    for (int j = 0; j < 3; j++) {                                       \
+                        if (xseg[j][2] <= 0) continue;                                  \
+                        int a = xseg[j][0] * 3 + c, b = (xseg[j][1] + 1) * 3 + c;       \
+                        T s = t1[b] - t0[b] - t1[a] + t0[a];                            \
+                        sum += (uint64_t)s * yseg[i][2] * xseg[j][2];                   \
+                    }                                                                   \
+                }                                                                       \
+                dst[x * 3 + c] = (unsigned char)((sum + area / 2) / area);              \
+            }                                                                           \
+        }                                                                               \
+    }                                                                                   \
+}
+
+DEFINE_BOX(uint32_t, box_32)
+DEFINE_BOX(uint64_t, box_64)
+
+int integral_image_build(integral_image* sat, const image_view* strip, int height, int first_row) {
+    int width = strip->width, rows = strip->height;
+    sat->width = width;
+    sat->height = height;
+    sat->first_row = first_row;
+    sat->rows = rows;
+    sat->wide = 255.0 * width * height > (double)UINT32_MAX;
+
+    size_t entries = (size_t)(rows + 1) * ROW_LEN(sat);
+    sat->data = malloc(entries * (sat->wide ? sizeof(uint64_t) : sizeof(uint32_t)));
+    if (!sat->data) return 0;
+
+    if (sat->wide) build_64(sat->data, strip);
+    else build_32(sat->data, strip);
+    return 1;
+}
+
+void integral_image_free(integral_image* sat) {
+    free(sat->data);
+    sat->data = NULL;
+}
+
+uint64_t integral_image_at(const integral_image* sat, int k, int x, int c) {
+    size_t i = (size_t)k * ROW_LEN(sat) + x * 3 + c;
+    return sat->wide ? ((const uint64_t*)sat->data)[i] : ((const uint32_t*)sat->data)[i];
+}
+
+void integral_box(const integral_image* sat, int radius, int y0, int rows, const image_view* out) {
+    if (sat->wide) box_64(sat, radius, y0, rows, out);
+    else box_32(sat, radius, y0, rows, out);
+}
+
+void box_radii_for_sigma(float sigma, int passes, int* radii) {
+    // widths wl and wl + 2 (both odd) mixed so the summed variance matches sigma^2
+    float var = 12.0f * sigma * sigma;
+    int wl = (int)floorf(sqrtf(var / passes + 1.0f));
+    if (wl % 2 == 0) wl--;
+    if (wl < 1) wl = 1;
+    int m = (int)roundf((var - passes * wl * wl - 4.0f * passes * wl - 3.0f * passes) / (-4.0f * wl - 4.0f));
+    for (int i = 0; i < passes; i++)
+        radii[i] = ((i < m) ? wl - 1 : wl + 1) / 2;
+}
+
+int box_blur_halo(float sigma, int passes) {
+    int radii[3], halo = 0;
+    box_radii_for_sigma(sigma, passes, radii);
+    for (int i = 0; i < passes; i++) halo += radii[i];
+    return halo;
+}
+
+int box_blur(const image_view* strip, int height, int first_row, int y0, int rows,
+             float sigma, int passes, const image_view* out) {
+    int radii[3], width = strip->width;
+    box_radii_for_sigma(sigma, passes, radii);
+
+    // every pass but the last also produces the rows the later passes will read
+    int remaining = 0;
+    for (int i = 0; i < passes; i++) remaining += radii[i];
+
+    image_view src = *strip;
+    int src_first = first_row;
+    unsigned char* prev = NULL;
+    for (int p = 0; p < passes; p++) {
+        int r = radii[p];
+        remaining -= r;
+        int a = y0 - remaining < 0 ? 0 : y0 - remaining;
+        int b = y0 + rows + remaining > height ? height : y0 + rows + remaining;
+
+        int lo = a - r < src_first ? src_first : a - r;
+        int hi = b + r > src_first + src.height ? src_first + src.height : b + r;
+
+        unsigned char* buf = (p == passes - 1) ? NULL : malloc((size_t)(b - a) * width * 3);
+        image_view dst = buf ? image_view_packed(buf, width, b - a) : *out;
+        image_view window = image_view_sub(&src, 0, lo - src_first, width, hi - lo);
+        integral_image sat;
+        if ((p < passes - 1 && !buf) || !integral_image_build(&sat, &window, height, lo)) {
+            free(buf);
+            free(prev);
+            return 0;
+        }
+        integral_box(&sat, r, a, b - a, &dst);
+        integral_image_free(&sat);
+
+        free(prev);
+        prev = buf;
+        src = dst;
+        src_first = a;
+    }
+    return 1;
+}
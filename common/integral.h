@@ -0,0 +1,48 @@
+// integral.h
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include <stdint.h>
+#include "image_view.h"
+
+// Per-channel summed-area table over image rows [first_row, first_row + rows).
+// Entry (k, x, c) holds the sum of channel c over columns [0, x) of the covered rows
+// above boundary k, so row 0 and column 0 are zero. Entries are 32-bit when
+// 255 * width * height fits, 64-bit otherwise.
+typedef struct {
+    int width, height;     // full image size, used for border clamping
+    int first_row, rows;   // image rows covered by the table
+    int wide;              // 1 when entries are uint64_t, 0 for uint32_t
+    void* data;            // (rows + 1) x (width + 1) x 3 entries
+} integral_image;
+
+// Build the table from the rows of `strip`, which are image rows from `first_row` on
+// of an image `height` rows tall. Rows are prefixed independently, then the vertical
+// prefix runs as a two-level scan across threads. Returns 0 on allocation failure.
+int integral_image_build(integral_image* sat, const image_view* strip, int height, int first_row);
+
+void integral_image_free(integral_image* sat);
+
+// Entry at table boundary k (0..rows), column boundary x (0..width), channel c
+uint64_t integral_image_at(const integral_image* sat, int k, int x, int c);
+
+// Box mean of radius r for image rows [y0, y0 + rows), borders clamped as in the
+// other filters, written to rows [0, rows) of `out`. Needs rows [y0 - r, y0 + rows + r)
+// (clamped to the image) in the table.
+void integral_box(const integral_image* sat, int radius, int y0, int rows, const image_view* out);
+
+// Box radii whose n-pass cascade best matches a Gaussian of the given sigma
+void box_radii_for_sigma(float sigma, int passes, int* radii);
+
+// One box (passes = 1) or a 3-box cascade (passes = 3) approximating a Gaussian of
+// `sigma`, O(1) per pixel whatever the radius, written to rows [0, rows) of `out`.
+// `strip` holds image rows [first_row, first_row + strip->height) of an image `height`
+// rows tall and must reach box_blur_halo() rows beyond [y0, y0 + rows) wherever the
+// image has them. Returns 0 on failure.
+int box_blur(const image_view* strip, int height, int first_row, int y0, int rows,
+             float sigma, int passes, const image_view* out);
+
+// Rows of input needed above and below a strip for box_blur
+int box_blur_halo(float sigma, int passes);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "png_mpi.h"
+#include "pngenc.h"
+#include "deflate.h"
+
+int png_is_png_path(const char* path) {
+    size_t n = strlen(path);
+    return n >= 4 && strcmp(path + n - 4, ".png") == 0;
+}
+
+// Write `n` bytes at `at` with independent calls of at most 1 GB each
+static int write_bytes(MPI_File f, MPI_Offset at, const unsigned char* p, size_t n) {
+    while (n > 0) {
+        int k = n < (1u << 30) ? (int)n : 1 << 30, written = 0;
+        MPI_Status status;
+        if (MPI_File_write_at(f, at, p, k, MPI_UNSIGNED_CHAR, &status) != MPI_SUCCESS ||
+            MPI_Get_count(&status, MPI_UNSIGNED_CHAR, &written) != MPI_SUCCESS || written != k)
+            return 0;
+        at += k;
+        p += k;
+        n -= (size_t)k;
+    }
+    return 1;
+}
+
+int png_write_rows_mpi(const char* path, int width, int height, int first, int rows,
+                       const unsigned char* src, size_t stride, int level, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // the stream is cut in rank order, so each strip must start where the previous
+    // rank's ends and the last must end at the bottom of the image
+    int expected = 0, in_order;
+    MPI_Exscan(&rows, &expected, 1, MPI_INT, MPI_SUM, comm);
+    if (rank == 0) expected = 0;
+    in_order = rows >= 0 && first == expected && (rank < size - 1 || first + rows == height);
+    MPI_Allreduce(MPI_IN_PLACE, &in_order, 1, MPI_INT, MPI_MIN, comm);
+    if (!in_order) {
+        if (rank == 0)
+            fprintf(stderr, "Error writing %s: the row strips are not contiguous in rank order\n",
+                    path);
+        return 0;
+    }
+
+    size_t row_bytes = (size_t)width * 3;
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // the last rows of the previous strip, then this strip, in one buffer: the
+    // previous rows give the filters their context and prime the match window
+    int want = png_history_rows(row_bytes);
+    int send = rows < want ? rows : want, ctx = 0;
+    int next = rank + 1 < size ? rank + 1 : MPI_PROC_NULL;
+    int prev = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+    MPI_Sendrecv(&send, 1, MPI_INT, next, 0, &ctx, 1, MPI_INT, prev, 0, comm, MPI_STATUS_IGNORE);
+    unsigned char* buf = malloc((size_t)(ctx + rows) * row_bytes);
+    if (!buf) {
+        fprintf(stderr, "Rank %d: out of memory for the PNG rows\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    for (int y = 0; y < rows; y++)
+        memcpy(buf + (size_t)(ctx + y) * row_bytes, src + (size_t)y * stride, row_bytes);
+    MPI_Sendrecv(buf + (size_t)(ctx + rows - send) * row_bytes, send, row, next, 1, buf, ctx, row,
+                 prev, 1, comm, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row);
+
+    png_part part;
+    int ok = png_deflate_rows(buf + (size_t)ctx * row_bytes, rows, ctx, row_bytes, row_bytes,
+                              level, rank == size - 1, &part);
+    free(buf);
+    if (!ok) fprintf(stderr, "Rank %d: out of memory deflating its rows\n", rank);
+
+    // the parts follow the header in rank order; the root chains their checksums
+    unsigned long long mine = part.size, before = 0, total = 0;
+    MPI_Exscan(&mine, &before, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) before = 0;
+    MPI_Allreduce(&mine, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+    unsigned long long sums[2] = { part.adler, part.raw }, *all = NULL;
+    if (rank == 0) {
+        all = malloc((size_t)size * sizeof(sums));
+        if (!all) {
+            fprintf(stderr, "Rank 0: out of memory for the PNG checksums\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gather(sums, 2, MPI_UNSIGNED_LONG_LONG, all, 2, MPI_UNSIGNED_LONG_LONG, 0, comm);
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    MPI_File f;
+    if (all_ok) {
+        ok = MPI_File_open(comm, (char*)path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                           &f) == MPI_SUCCESS;
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+        if (!all_ok && ok) MPI_File_close(&f);
+        if (!all_ok && rank == 0) fprintf(stderr, "Error creating %s\n", path);
+    }
+    if (all_ok) {
+        // an older, larger file at the same path must not leave a tail
+        MPI_Offset end = PNG_HEADER_BYTES + (MPI_Offset)total;
+        ok = MPI_File_set_size(f, end + PNG_TRAILER_BYTES) == MPI_SUCCESS &&
+             write_bytes(f, PNG_HEADER_BYTES + (MPI_Offset)before, part.chunks, part.size);
+        if (rank == 0) {
+            unsigned char header[PNG_HEADER_BYTES], trailer[PNG_TRAILER_BYTES];
+            uint32_t adler = 1;
+            for (int r = 0; r < size; r++)
+                adler = adler32_combine(adler, (uint32_t)all[2 * r], (size_t)all[2 * r + 1]);
+            png_header(width, height, level, header);
+            png_trailer(adler, trailer);
+            ok = ok && write_bytes(f, 0, header, PNG_HEADER_BYTES) &&
+                 write_bytes(f, end, trailer, PNG_TRAILER_BYTES);
+        }
+        MPI_File_close(&f);
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+        if (!all_ok && rank == 0) fprintf(stderr, "Error writing %s\n", path);
+    }
+    free(all);
+    free(part.chunks);
+    return all_ok;
+}
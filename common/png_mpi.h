@@ -0,0 +1,23 @@
+// png_mpi.h
+#ifndef PNG_MPI_H
+#define PNG_MPI_H
+
+#include <stddef.h>
+#include <mpi.h>
+
+// Whether `path` ends in ".png"
+int png_is_png_path(const char* path);
+
+// Write a `width` x `height` RGB PNG at `path` from row strips: every rank passes its
+// `rows` rows from image row `first` (`src`, rows `stride` bytes apart), the strips in
+// rank order and covering the image; if they are not, every rank returns 0 with nothing
+// written. Each rank filters and deflates its own rows at
+// `level` (deflate.h) into its part of the zlib stream, primed with the end of the
+// previous rank's strip, which it receives from that rank, so the file is about the
+// size of a serial encode. The ranks write their parts straight into the file; the
+// root writes the header and, once it has combined the parts' Adler-32s, the
+// trailer. Collective; returns 0 on every rank if the file could not be written.
+int png_write_rows_mpi(const char* path, int width, int height, int first, int rows,
+                       const unsigned char* src, size_t stride, int level, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "pngenc.h"
+#include "deflate.h"
+
+// Longest chunk data written; PNG allows up to 2^31 - 1 bytes
+#define MAX_CHUNK (1u << 30)
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+uint32_t png_crc32(uint32_t crc, const unsigned char* p, size_t n) {
+    // a 1 KB table is cheaper to rebuild per call than to share safely between threads
+    uint32_t table[256];
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// One chunk of `n` bytes of `data` at `dst`; returns its size
+static size_t put_chunk(const char* type, const unsigned char* data, size_t n, unsigned char* dst) {
+    put_u32(dst, (uint32_t)n);
+    memcpy(dst + 4, type, 4);
+    if (n) memcpy(dst + 8, data, n);
+    put_u32(dst + 8 + n, png_crc32(0, dst + 4, n + 4));
+    return n + 12;
+}
+
+void png_header(int width, int height, int level, unsigned char* dst) {
+    unsigned char ihdr[13], zlib[2];
+    put_u32(ihdr, (uint32_t)width);
+    put_u32(ihdr + 4, (uint32_t)height);
+    ihdr[8] = 8;    // bits per sample
+    ihdr[9] = 2;    // RGB
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;   // deflate, adaptive filters, no interlace
+    memcpy(dst, "\x89PNG\r\n\x1a\n", 8);
+    size_t n = 8 + put_chunk("IHDR", ihdr, 13, dst + 8);
+    zlib_header(level, zlib);
+    put_chunk("IDAT", zlib, 2, dst + n);
+}
+
+void png_trailer(uint32_t adler, unsigned char* dst) {
+    unsigned char sum[4];
+    put_u32(sum, adler);
+    size_t n = put_chunk("IDAT", sum, 4, dst);
+    put_chunk("IEND", NULL, 0, dst + n);
+}
+
+size_t png_idat_bound(size_t n) {
+    return n + 12 * (n / MAX_CHUNK + 1);
+}
+
+size_t png_put_idat(const unsigned char* data, size_t n, unsigned char* dst) {
+    size_t out = 0;
+    for (size_t at = 0; at < n; at += MAX_CHUNK) {
+        size_t k = n - at < MAX_CHUNK ? n - at : MAX_CHUNK;
+        out += put_chunk("IDAT", data + at, k, dst + out);
+    }
+    return out;
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Residual of byte i under filter f (1 Sub, 2 Up, 3 Average, 4 Paeth; 0 None)
+static unsigned char residual(int f, const unsigned char* row, const unsigned char* prev,
+                              size_t i) {
+    int x = row[i], a = i >= 3 ? row[i - 3] : 0, b = prev ? prev[i] : 0;
+    int c = prev && i >= 3 ? prev[i - 3] : 0;
+    switch (f) {
+    case 1: return (unsigned char)(x - a);
+    case 2: return (unsigned char)(x - b);
+    case 3: return (unsigned char)(x - (a + b) / 2);
+    case 4: return (unsigned char)(x - paeth(a, b, c));
+    default: return (unsigned char)x;
+    }
+}
+
+void png_filter_row(const unsigned char* row, const unsigned char* prev, size_t row_bytes,
+                    unsigned char* dst) {
+    // residuals read as signed bytes: small magnitudes are what deflate codes best
+    uint64_t cost[5] = {0};
+    for (size_t i = 0; i < row_bytes; i++)
+        for (int f = 0; f < 5; f++)
+            cost[f] += (uint64_t)abs((signed char)residual(f, row, prev, i));
+    int best = 0;
+    for (int f = 1; f < 5; f++)
+        if (cost[f] < cost[best]) best = f;
+    dst[0] = (unsigned char)best;
+    for (size_t i = 0; i < row_bytes; i++) dst[1 + i] = residual(best, row, prev, i);
+}
+
+int png_history_rows(size_t row_bytes) {
+    return (int)((32768 + row_bytes) / (row_bytes + 1)) + 1;
+}
+
+int png_deflate_rows(const unsigned char* src, int rows, int before, size_t stride,
+                     size_t row_bytes, int level, int last, png_part* part) {
+    memset(part, 0, sizeof(*part));
+    int ctx = before < png_history_rows(row_bytes) ? before : png_history_rows(row_bytes);
+
+    // filtered rows j0 .. ctx + rows - 1 of the part's rows and context; the first
+    // context row only serves as the row above the second
+    int j0 = ctx > 0, hist = ctx - j0;
+    size_t fb = row_bytes + 1, n = (size_t)rows * fb;
+    unsigned char* filtered = malloc((size_t)(hist + rows) * fb);
+    unsigned char* packed = malloc(deflate_bound(n));
+    if (!filtered || !packed) {
+        free(filtered);
+        free(packed);
+        return 0;
+    }
+    for (int j = j0; j < ctx + rows; j++) {
+        const unsigned char* row = src + ((ptrdiff_t)j - ctx) * (ptrdiff_t)stride;
+        unsigned char* dst = filtered + (size_t)(j - j0) * fb;
+        if (level == 0) {
+            // stored rows gain nothing from a filter
+            dst[0] = 0;
+            memcpy(dst + 1, row, row_bytes);
+        } else {
+            png_filter_row(row, j > 0 ? row - stride : NULL, row_bytes, dst);
+        }
+    }
+    const unsigned char* own = filtered + (size_t)hist * fb;
+    size_t size = deflate_piece(own, n, (size_t)hist * fb, level, last, packed);
+    part->adler = adler32_update(1, own, n);
+    part->raw = n;
+    free(filtered);
+
+    part->chunks = size ? malloc(png_idat_bound(size)) : NULL;
+    if (part->chunks) part->size = png_put_idat(packed, size, part->chunks);
+    free(packed);
+    return part->chunks != NULL;
+}
+
+int png_write_file(const char* path, const unsigned char* img, int width, int height,
+                   size_t stride, int level) {
+    size_t row_bytes = (size_t)width * 3;
+    size_t min_rows = 65536 / (row_bytes + 1) + 1;
+    int parts = omp_get_max_threads();
+    if ((size_t)parts > (size_t)height / min_rows) parts = (int)((size_t)height / min_rows);
+    if (parts < 1) parts = 1;
+    png_part* part = calloc((size_t)parts, sizeof(png_part));
+    if (!part) return 0;
+
+    // each part's rows start at a row boundary of the even split; the rows before it are
+    // in `img` already, so every part primes its window as if encoded in one go
+    int ok = 1;
+    #pragma omp parallel for schedule(static) reduction(&& : ok)
+    for (int p = 0; p < parts; p++) {
+        int first = (int)((long long)height * p / parts);
+        int rows = (int)((long long)height * (p + 1) / parts) - first;
+        if (!png_deflate_rows(img + (size_t)first * stride, rows, first, stride, row_bytes,
+                              level, p == parts - 1, &part[p]))
+            ok = 0;
+    }
+
+    FILE* f = ok ? fopen(path, "wb") : NULL;
+    if (f) {
+        unsigned char header[PNG_HEADER_BYTES], trailer[PNG_TRAILER_BYTES];
+        uint32_t adler = 1;
+        png_header(width, height, level, header);
+        ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+        for (int p = 0; p < parts; p++) {
+            ok = ok && fwrite(part[p].chunks, 1, part[p].size, f) == part[p].size;
+            adler = adler32_combine(adler, part[p].adler, part[p].raw);
+        }
+        png_trailer(adler, trailer);
+        ok = ok && fwrite(trailer, 1, sizeof(trailer), f) == sizeof(trailer);
+        ok = fclose(f) == 0 && ok;
+    } else {
+        ok = 0;
+    }
+    for (int p = 0; p < parts; p++) free(part[p].chunks);
+    free(part);
+    return ok;
+}
+
+static const struct {
+    const char* name;
+    int level;
+} level_names[] = {{"store", 0}, {"fast", 1}, {"default", DEFLATE_DEFAULT_LEVEL}, {"best", 9}};
+
+int parse_png_level(const char* name, int* level) {
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (strcmp(name, level_names[i].name) == 0) {
+            *level = level_names[i].level;
+            return 1;
+        }
+    }
+    if (name[0] >= '0' && name[0] <= '0' + DEFLATE_MAX_LEVEL && name[1] == '\0') {
+        *level = name[0] - '0';
+        return 1;
+    }
+    return 0;
+}
+
+int png_level(void) {
+    int level = DEFLATE_DEFAULT_LEVEL;
+    const char* env = getenv("HPC_FILTER_PNG_LEVEL");
+    if (env && *env && !parse_png_level(env, &level)) {
+        fprintf(stderr, "Warning: unknown HPC_FILTER_PNG_LEVEL '%s', using %d\n", env,
+                DEFLATE_DEFAULT_LEVEL);
+        level = DEFLATE_DEFAULT_LEVEL;
+    }
+    return level;
+}
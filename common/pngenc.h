@@ -0,0 +1,72 @@
+// pngenc.h
+#ifndef PNGENC_H
+#define PNGENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pieces of an 8-bit RGB PNG encoder whose rows are filtered and deflated in
+// independent parts (pngenc.c, png_mpi.c): a file is the header, the parts' IDAT
+// chunks in row order, then the trailer, with the zlib stream's header and checksum
+// in IDAT chunks of their own.
+
+// Signature, IHDR and the IDAT holding the zlib header
+#define PNG_HEADER_BYTES 47
+// IDAT holding the Adler-32, and IEND
+#define PNG_TRAILER_BYTES 28
+
+void png_header(int width, int height, int level, unsigned char* dst);
+void png_trailer(uint32_t adler, unsigned char* dst);
+
+// Filter one row of `row_bytes` bytes into `dst` (a filter type byte, then the
+// residuals), choosing per row the filter whose residuals have the smallest sum of
+// absolute values. `prev` is the row above, NULL for the top row of the image.
+void png_filter_row(const unsigned char* row, const unsigned char* prev, size_t row_bytes,
+                    unsigned char* dst);
+
+// CRC-32 of `n` more bytes after `crc` (0 for none), as PNG chunks use
+uint32_t png_crc32(uint32_t crc, const unsigned char* p, size_t n);
+
+// Most bytes png_put_idat writes for `n` bytes of data
+size_t png_idat_bound(size_t n);
+
+// Wrap `n` bytes of zlib data in IDAT chunks at `dst`; returns the bytes written
+size_t png_put_idat(const unsigned char* data, size_t n, unsigned char* dst);
+
+// One part of the image's zlib stream, ready to write between the header and trailer
+typedef struct {
+    unsigned char* chunks;   // IDAT chunks (malloc'd)
+    size_t size;
+    uint32_t adler;          // Adler-32 of the part's filtered rows
+    size_t raw;              // filtered bytes, for adler32_combine
+} png_part;
+
+// Encode `rows` rows of `row_bytes` bytes at `src`, rows `stride` bytes apart, as a
+// part of the stream. The `before` rows above `src` (at the same stride) are the
+// image rows just before the part, or fewer at the top of the image: the row right
+// above is the filters' context and the rows before it prime the match window, so the
+// part compresses as if the image were deflated in one go. `last` ends the stream.
+// Returns 0 if memory runs out.
+int png_deflate_rows(const unsigned char* src, int rows, int before, size_t stride,
+                     size_t row_bytes, int level, int last, png_part* part);
+
+// Rows of history png_deflate_rows can use, the filter context row included
+int png_history_rows(size_t row_bytes);
+
+// Write a `width` x `height` RGB image (`img`, rows `stride` bytes apart) as a PNG at
+// `path`. The rows are cut into one part per OpenMP thread, each at least 64 KB, and
+// the parts are filtered and deflated in parallel, then written in order. Level 0
+// stores the rows unfiltered, for when speed beats size. Returns 0 if memory runs out
+// or the file cannot be written.
+int png_write_file(const char* path, const unsigned char* img, int width, int height,
+                   size_t stride, int level);
+
+// Level for the PNG encoders: HPC_FILTER_PNG_LEVEL if set, else DEFLATE_DEFAULT_LEVEL.
+// An unknown value is refused with a warning.
+int png_level(void);
+
+// Parse "store" (0), "fast" (1), "default" (6), "best" (9) or a level 0..9. Returns 0
+// for anything else.
+int parse_png_level(const char* name, int* level);
+
+#endif
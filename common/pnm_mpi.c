@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "pnm_mpi.h"
+
+// Next decimal field of a PNM header, skipping whitespace and # comments
+static int read_header_int(FILE* f, int* v) {
+    int c = fgetc(f);
+    for (;;) {
+        while (c != EOF && isspace(c)) c = fgetc(f);
+        if (c != '#') break;
+        while (c != EOF && c != '\n') c = fgetc(f);
+    }
+    if (c == EOF || !isdigit(c)) return 0;
+    long n = 0;
+    while (c != EOF && isdigit(c)) {
+        n = n * 10 + (c - '0');
+        if (n > INT_MAX) return 0;
+        c = fgetc(f);
+    }
+    ungetc(c, f);
+    *v = (int)n;
+    return 1;
+}
+
+int pnm_read_header_mpi(const char* path, pnm_header* h, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // width, height, channels, data offset; 0 channels when the file is not usable
+    long long info[4] = { 0, 0, 0, 0 };
+    if (rank == 0) {
+        FILE* f = fopen(path, "rb");
+        if (f) {
+            char magic[2];
+            int w, ht, maxval;
+            if (fread(magic, 1, 2, f) == 2 && magic[0] == 'P' &&
+                (magic[1] == '5' || magic[1] == '6') && read_header_int(f, &w) &&
+                read_header_int(f, &ht) && read_header_int(f, &maxval) &&
+                w > 0 && ht > 0 && maxval > 0 && maxval <= 255 && isspace(fgetc(f))) {
+                info[0] = w;
+                info[1] = ht;
+                info[2] = magic[1] == '6' ? 3 : 1;
+                info[3] = ftell(f);
+            }
+            fclose(f);
+        }
+    }
+    MPI_Bcast(info, 4, MPI_LONG_LONG, 0, comm);
+    if (!info[2]) return 0;
+    h->width = (int)info[0];
+    h->height = (int)info[1];
+    h->channels = (int)info[2];
+    h->data = (MPI_Offset)info[3];
+    return 1;
+}
+
+int pnm_read_rows_mpi(const char* path, const pnm_header* h, int first_row, int rows,
+                      unsigned char* dst, MPI_Comm comm) {
+    MPI_File f;
+    int ok = MPI_File_open(comm, (char*)path, MPI_MODE_RDONLY, MPI_INFO_NULL, &f) == MPI_SUCCESS;
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        if (ok) MPI_File_close(&f);
+        return 0;
+    }
+
+    // counts are in rows, as in the strip transfers
+    size_t row_bytes = (size_t)h->width * h->channels;
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // one contiguous run of file rows per call, split where the rows wrap; every rank
+    // makes as many collective calls as the rank with the most runs
+    int runs = 0;
+    for (int i = 0; i < rows; runs++) {
+        int g = ((first_row + i) % h->height + h->height) % h->height;
+        i += (rows - i < h->height - g) ? rows - i : h->height - g;
+    }
+    int max_runs;
+    MPI_Allreduce(&runs, &max_runs, 1, MPI_INT, MPI_MAX, comm);
+
+    for (int k = 0, i = 0; k < max_runs; k++) {
+        int g = 0, n = 0;
+        if (i < rows) {
+            g = ((first_row + i) % h->height + h->height) % h->height;
+            n = (rows - i < h->height - g) ? rows - i : h->height - g;
+        }
+        MPI_Status status;
+        int got = 0;
+        if (MPI_File_read_at_all(f, h->data + (MPI_Offset)g * (MPI_Offset)row_bytes,
+                                 dst + (size_t)i * row_bytes, n, row, &status) != MPI_SUCCESS ||
+            MPI_Get_count(&status, row, &got) != MPI_SUCCESS || got != n)
+            ok = 0;
+        i += n;
+    }
+    MPI_Type_free(&row);
+    MPI_File_close(&f);
+
+    // grey samples were read packed; spread them to RGB from the back so none is
+    // overwritten before it is read
+    if (ok && h->channels == 1) {
+        for (size_t k = (size_t)rows * h->width; k-- > 0;) {
+            unsigned char v = dst[k];
+            dst[3 * k] = dst[3 * k + 1] = dst[3 * k + 2] = v;
+        }
+    }
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    return all_ok;
+}
+
+int pnm_read_block_mpi(const char* path, const pnm_header* h, int x0, int y0, int cols,
+                       int rows, unsigned char* dst, size_t dst_stride, MPI_Comm comm) {
+    MPI_File f;
+    int ok = MPI_File_open(comm, (char*)path, MPI_MODE_RDONLY, MPI_INFO_NULL, &f) == MPI_SUCCESS;
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        if (ok) MPI_File_close(&f);
+        return 0;
+    }
+
+    // the block's rows are `width` pixels apart in the file and `dst_stride` bytes in
+    // memory; grey rows land at the start of their RGB rows
+    int n = h->channels;
+    MPI_Datatype file_block, mem_block;
+    MPI_Type_vector(rows, cols * n, h->width * n, MPI_UNSIGNED_CHAR, &file_block);
+    MPI_Type_commit(&file_block);
+    MPI_Type_vector(rows, cols * n, (int)dst_stride, MPI_UNSIGNED_CHAR, &mem_block);
+    MPI_Type_commit(&mem_block);
+    MPI_Offset at = h->data + ((MPI_Offset)y0 * h->width + x0) * n;
+    MPI_Status status;
+    if (MPI_File_set_view(f, at, MPI_UNSIGNED_CHAR, file_block, "native",
+                          MPI_INFO_NULL) != MPI_SUCCESS ||
+        MPI_File_read_at_all(f, 0, dst, 1, mem_block, &status) != MPI_SUCCESS)
+        ok = 0;
+    MPI_Type_free(&file_block);
+    MPI_Type_free(&mem_block);
+    MPI_File_close(&f);
+
+    // spread grey samples from the back of each row, as in pnm_read_rows_mpi
+    if (ok && n == 1) {
+        for (int y = 0; y < rows; y++) {
+            unsigned char* p = dst + (size_t)y * dst_stride;
+            for (int k = cols; k-- > 0;) p[3 * k] = p[3 * k + 1] = p[3 * k + 2] = p[k];
+        }
+    }
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    return all_ok;
+}
+
+int pnm_is_ppm_path(const char* path) {
+    size_t n = strlen(path);
+    return n >= 4 && strcmp(path + n - 4, ".ppm") == 0;
+}
+
+int pnm_create_mpi(const char* path, int width, int height, MPI_File* f, MPI_Offset* data,
+                   MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    int ok = MPI_File_open(comm, (char*)path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                           f) == MPI_SUCCESS;
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        if (ok) MPI_File_close(f);
+        if (rank == 0) fprintf(stderr, "Error creating %s\n", path);
+        return 0;
+    }
+
+    // an older, larger file at the same path must not leave a tail
+    MPI_Status status;
+    if (MPI_File_set_size(*f, header_len + (MPI_Offset)width * height * 3) != MPI_SUCCESS) ok = 0;
+    if (rank == 0 && MPI_File_write_at(*f, 0, header, header_len, MPI_CHAR, &status) != MPI_SUCCESS)
+        ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        MPI_File_close(f);
+        if (rank == 0) fprintf(stderr, "Error writing %s\n", path);
+        return 0;
+    }
+    *data = header_len;
+    return 1;
+}
+
+int pnm_write_block_mpi(const char* path, int width, int height, int x0, int y0, int cols,
+                        int rows, const unsigned char* src, size_t src_stride, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_File f;
+    MPI_Offset data;
+    if (!pnm_create_mpi(path, width, height, &f, &data, comm)) return 0;
+    int ok = 1, all_ok;
+    MPI_Status status;
+
+    // the block's rows are `width` pixels apart in the file and `src_stride` bytes in memory
+    MPI_Datatype file_block, mem_block;
+    MPI_Type_vector(rows, cols * 3, width * 3, MPI_UNSIGNED_CHAR, &file_block);
+    MPI_Type_commit(&file_block);
+    MPI_Type_vector(rows, cols * 3, (int)src_stride, MPI_UNSIGNED_CHAR, &mem_block);
+    MPI_Type_commit(&mem_block);
+    MPI_Offset at = data + ((MPI_Offset)y0 * width + x0) * 3;
+    if (MPI_File_set_view(f, at, MPI_UNSIGNED_CHAR, file_block, "native",
+                          MPI_INFO_NULL) != MPI_SUCCESS ||
+        MPI_File_write_at_all(f, 0, src, 1, mem_block, &status) != MPI_SUCCESS)
+        ok = 0;
+    MPI_Type_free(&file_block);
+    MPI_Type_free(&mem_block);
+    MPI_File_close(&f);
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok && rank == 0) fprintf(stderr, "Error writing %s\n", path);
+    return all_ok;
+}
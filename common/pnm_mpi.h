@@ -0,0 +1,56 @@
+// pnm_mpi.h
+#ifndef PNM_MPI_H
+#define PNM_MPI_H
+
+#include <mpi.h>
+
+// Binary PPM (P6) or PGM (P5) file with 8-bit samples: pixel rows are stored raw after
+// the header, so any rank can read any rows straight from the file
+typedef struct {
+    int width, height;
+    int channels;          // 3 for PPM, 1 for PGM
+    MPI_Offset data;       // byte offset of the first pixel
+} pnm_header;
+
+// Parse the header of `path` on the root and broadcast it. Collective; returns 0 on
+// every rank if the file cannot be opened or is not an 8-bit P5/P6 file, without
+// printing anything, so callers can fall back to another decoder.
+int pnm_read_header_mpi(const char* path, pnm_header* h, MPI_Comm comm);
+
+// Read `rows` image rows starting at `first_row` into packed RGB rows at `dst`
+// (grey expands to RGB). Rows past either edge wrap around the image, so a strip can
+// read a periodic halo in the same call. Collective with MPI_File_read_at_all: every
+// rank calls it, with `rows` 0 if it needs none. Returns 0 on every rank if any read
+// failed.
+int pnm_read_rows_mpi(const char* path, const pnm_header* h, int first_row, int rows,
+                      unsigned char* dst, MPI_Comm comm);
+
+// Read one block of the image: `rows` rows from `y0` of `cols` columns from `x0`, into
+// packed RGB rows `dst_stride` bytes apart at `dst` (grey expands to RGB). Collective
+// through a strided file view and MPI_File_read_at_all, the reverse of
+// pnm_write_block_mpi, so no rank reads more than its own block. Returns 0 on every
+// rank if any read failed.
+int pnm_read_block_mpi(const char* path, const pnm_header* h, int x0, int y0, int cols,
+                       int rows, unsigned char* dst, size_t dst_stride, MPI_Comm comm);
+
+// Whether `path` ends in ".ppm", the outputs the MPI backends write in parallel
+int pnm_is_ppm_path(const char* path);
+
+// Create the `width` x `height` binary PPM at `path` for the ranks to fill: the file is
+// cut to the image size and the root writes the header. Pixels go at `*data` plus
+// (y * width + x) * 3, written by each rank with independent MPI_File_write_at calls
+// or collectively; MPI_File_close ends it. Collective; returns 0 on every rank,
+// with nothing left open, if the file cannot be created.
+int pnm_create_mpi(const char* path, int width, int height, MPI_File* f, MPI_Offset* data,
+                   MPI_Comm comm);
+
+// Write one block of a `width` x `height` binary PPM at `path`: `rows` rows from `y0`
+// of `cols` columns from `x0`, read from `src` with rows `src_stride` bytes apart.
+// Every rank writes its own block and the blocks tile the image; the root also writes
+// the header, and the file is cut to the image size. Collective through a strided
+// file view and MPI_File_write_at_all, so no rank needs more than its own block.
+// Returns 0 on every rank if the file could not be written.
+int pnm_write_block_mpi(const char* path, int width, int height, int x0, int y0, int cols,
+                        int rows, const unsigned char* src, size_t src_stride, MPI_Comm comm);
+
+#endif
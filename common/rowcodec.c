@@ -0,0 +1,79 @@
+#include "rowcodec.h"
+
+// Control bytes: c < 128 is followed by c + 1 literal residuals, c >= 128 by one
+// residual repeated c - 126 times (2..129). The packer codes runs of 3 or more only:
+// a run then always saves the byte that ends the literals before it, so a row grows
+// by at most one byte per full literal block plus one.
+#define MAX_LITERAL 128
+#define MIN_RUN 3
+#define MAX_RUN 129
+
+size_t row_pack_bound(int rows, size_t row_bytes) {
+    return (size_t)rows * (row_bytes + row_bytes / MAX_LITERAL + 1);
+}
+
+// Residual i of a row: the byte minus the same channel one pixel left, modulo 256
+static unsigned char residual(const unsigned char* row, size_t i) {
+    return (unsigned char)(i < 3 ? row[i] : row[i] - row[i - 3]);
+}
+
+// Code residuals [from, from + count) of a row as literal blocks
+static size_t put_literals(const unsigned char* row, size_t from, size_t count,
+                           unsigned char* dst) {
+    size_t out = 0;
+    while (count > 0) {
+        size_t k = count < MAX_LITERAL ? count : MAX_LITERAL;
+        dst[out++] = (unsigned char)(k - 1);
+        for (size_t j = 0; j < k; j++) dst[out++] = residual(row, from + j);
+        from += k;
+        count -= k;
+    }
+    return out;
+}
+
+static size_t pack_row(const unsigned char* row, size_t n, unsigned char* dst) {
+    size_t out = 0, i = 0, lit = 0;   // pending literals are residuals [i - lit, i)
+    while (i < n) {
+        unsigned char r = residual(row, i);
+        size_t run = 1;
+        while (i + run < n && run < MAX_RUN && residual(row, i + run) == r) run++;
+        if (run >= MIN_RUN) {
+            out += put_literals(row, i - lit, lit, dst + out);
+            lit = 0;
+            dst[out++] = (unsigned char)(run + 126);
+            dst[out++] = r;
+        } else {
+            lit += run;
+        }
+        i += run;
+    }
+    return out + put_literals(row, n - lit, lit, dst + out);
+}
+
+size_t row_pack(const unsigned char* src, int rows, size_t row_bytes, size_t stride,
+                unsigned char* dst) {
+    size_t out = 0;
+    for (int y = 0; y < rows; y++) out += pack_row(src + (size_t)y * stride, row_bytes, dst + out);
+    return out;
+}
+
+int row_unpack(const unsigned char* src, size_t n, int rows, size_t row_bytes, size_t stride,
+               unsigned char* dst) {
+    size_t in = 0;
+    for (int y = 0; y < rows; y++) {
+        unsigned char* row = dst + (size_t)y * stride;
+        size_t i = 0;
+        while (i < row_bytes) {
+            if (in >= n) return 0;
+            unsigned c = src[in++];
+            size_t k = c < 128 ? c + 1 : c - 126;
+            if (i + k > row_bytes || in + (c < 128 ? k : 1) > n) return 0;
+            for (size_t j = 0; j < k; j++, i++) {
+                unsigned char r = c < 128 ? src[in + j] : src[in];
+                row[i] = (unsigned char)(i < 3 ? r : r + row[i - 3]);
+            }
+            in += c < 128 ? k : 1;
+        }
+    }
+    return in == n;
+}
@@ -0,0 +1,27 @@
+// rowcodec.h
+#ifndef ROWCODEC_H
+#define ROWCODEC_H
+
+#include <stddef.h>
+
+// Lossless codec for 8-bit RGB rows, for moving filter results between processes:
+// every byte is predicted from the same channel of the pixel to its left (the first
+// pixel of a row from nothing), and the residuals are run-length coded as in PackBits.
+// Flat regions, such as the background of edges or emboss output, shrink to a few
+// bytes per row; noisy photographs stay about the same size, never more than one byte
+// in 128 larger. Rows are coded independently, so any row range can be packed alone.
+
+// Most bytes row_pack writes for `rows` rows of `row_bytes` bytes
+size_t row_pack_bound(int rows, size_t row_bytes);
+
+// Pack `rows` rows of `row_bytes` bytes from `src`, rows `stride` bytes apart, into
+// `dst` (row_pack_bound bytes). Returns the packed size.
+size_t row_pack(const unsigned char* src, int rows, size_t row_bytes, size_t stride,
+                unsigned char* dst);
+
+// Unpack `n` bytes from row_pack into `rows` rows of `row_bytes` bytes at `dst`, rows
+// `stride` bytes apart. Returns 0 if the data does not decode to exactly that many rows.
+int row_unpack(const unsigned char* src, size_t n, int rows, size_t row_bytes, size_t stride,
+               unsigned char* dst);
+
+#endif
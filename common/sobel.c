@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cpu_dispatch.h"
+#include "sobel.h"
+#ifdef ISA_X86
+#include <immintrin.h>
+#endif
+
+// Vertical passes for one output row: vs = a + 2b + c (feeds Gx), vd = c - a (feeds Gy).
+// Both arrays carry 3 extra entries on each side, filled with the edge pixel's values
+// so the horizontal taps at x - 1 and x + 1 clamp without branches.
+static void vertical_span(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                          int from, int n, int16_t* vs, int16_t* vd) {
+    for (int i = from; i < n; i++) {
+        vs[3 + i] = (int16_t)(a[i] + 2 * b[i] + c[i]);
+        vd[3 + i] = (int16_t)(c[i] - a[i]);
+    }
+    for (int k = 0; k < 3; k++) {
+        vs[k] = vs[3 + k];         vd[k] = vd[3 + k];
+        vs[n + 3 + k] = vs[n + k]; vd[n + 3 + k] = vd[n + k];
+    }
+}
+
+// Horizontal passes and magnitude: gx = vs[x+1] - vs[x-1], gy = vd[x-1] + 2vd[x] + vd[x+1]
+static void horizontal_span(const int16_t* vs, const int16_t* vd, int from, int n, unsigned char* dst) {
+    for (int i = from; i < n; i++) {
+        int gx = vs[i + 6] - vs[i];
+        int gy = vd[i] + 2 * vd[i + 3] + vd[i + 6];
+        int mag = (int)sqrtf((float)(gx * gx + gy * gy));
+        dst[i] = (unsigned char)(mag > 255 ? 255 : mag);
+    }
+}
+
+typedef void (*sobel_row_fn)(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                             int n, int16_t* vs, int16_t* vd, unsigned char* dst);
+
+static void row_scalar(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                       int n, int16_t* vs, int16_t* vd, unsigned char* dst) {
+    vertical_span(a, b, c, 0, n, vs, vd);
+    horizontal_span(vs, vd, 0, n, dst);
+}
+
+#ifdef ISA_X86
+// In the vector rows, gx^2 + gy^2 comes from madd on interleaved (gx, gy) pairs, then
+// an exact sqrt, truncation and saturating packs
+ISA_TARGET("sse4.1")
+static void row_sse41(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                      int n, int16_t* vs, int16_t* vd, unsigned char* dst) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i va = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(a + i)));
+        __m128i vb = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(b + i)));
+        __m128i vc = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(c + i)));
+        __m128i s = _mm_add_epi16(_mm_add_epi16(va, vc), _mm_slli_epi16(vb, 1));
+        _mm_storeu_si128((__m128i*)(vs + 3 + i), s);
+        _mm_storeu_si128((__m128i*)(vd + 3 + i), _mm_sub_epi16(vc, va));
+    }
+    vertical_span(a, b, c, i, n, vs, vd);
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i gx = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(vs + i + 6)),
+                                   _mm_loadu_si128((const __m128i*)(vs + i)));
+        __m128i gy = _mm_add_epi16(
+            _mm_add_epi16(_mm_loadu_si128((const __m128i*)(vd + i)),
+                          _mm_loadu_si128((const __m128i*)(vd + i + 6))),
+            _mm_slli_epi16(_mm_loadu_si128((const __m128i*)(vd + i + 3)), 1));
+
+        __m128i lo = _mm_unpacklo_epi16(gx, gy), hi = _mm_unpackhi_epi16(gx, gy);
+        __m128 mlo = _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo)));
+        __m128 mhi = _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi)));
+        __m128i m16 = _mm_packus_epi32(_mm_cvttps_epi32(mlo), _mm_cvttps_epi32(mhi));
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(m16, m16));
+    }
+    horizontal_span(vs, vd, i, n, dst);
+}
+
+ISA_TARGET("avx2")
+static void row_avx2(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                     int n, int16_t* vs, int16_t* vd, unsigned char* dst) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+        __m256i vc = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(c + i)));
+        __m256i s = _mm256_add_epi16(_mm256_add_epi16(va, vc), _mm256_slli_epi16(vb, 1));
+        _mm256_storeu_si256((__m256i*)(vs + 3 + i), s);
+        _mm256_storeu_si256((__m256i*)(vd + 3 + i), _mm256_sub_epi16(vc, va));
+    }
+    vertical_span(a, b, c, i, n, vs, vd);
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256i gx = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(vs + i + 6)),
+                                      _mm256_loadu_si256((const __m256i*)(vs + i)));
+        __m256i gy = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(vd + i)),
+                             _mm256_loadu_si256((const __m256i*)(vd + i + 6))),
+            _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)(vd + i + 3)), 1));
+
+        // unpack and pack are both per 128-bit lane, so values come back in order
+        __m256i lo = _mm256_unpacklo_epi16(gx, gy), hi = _mm256_unpackhi_epi16(gx, gy);
+        __m256 mlo = _mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo)));
+        __m256 mhi = _mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi)));
+        __m256i m16 = _mm256_packus_epi32(_mm256_cvttps_epi32(mlo), _mm256_cvttps_epi32(mhi));
+        __m256i m8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(m16, m16), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(m8));
+    }
+    horizontal_span(vs, vd, i, n, dst);
+}
+
+ISA_TARGET("avx512f,avx512bw")
+static void row_avx512(const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                       int n, int16_t* vs, int16_t* vd, unsigned char* dst) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i va = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i)));
+        __m512i vb = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i)));
+        __m512i vc = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(c + i)));
+        __m512i s = _mm512_add_epi16(_mm512_add_epi16(va, vc), _mm512_slli_epi16(vb, 1));
+        _mm512_storeu_si512(vs + 3 + i, s);
+        _mm512_storeu_si512(vd + 3 + i, _mm512_sub_epi16(vc, va));
+    }
+    vertical_span(a, b, c, i, n, vs, vd);
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m512i gx = _mm512_sub_epi16(_mm512_loadu_si512(vs + i + 6), _mm512_loadu_si512(vs + i));
+        __m512i gy = _mm512_add_epi16(
+            _mm512_add_epi16(_mm512_loadu_si512(vd + i), _mm512_loadu_si512(vd + i + 6)),
+            _mm512_slli_epi16(_mm512_loadu_si512(vd + i + 3), 1));
+
+        __m512i lo = _mm512_unpacklo_epi16(gx, gy), hi = _mm512_unpackhi_epi16(gx, gy);
+        __m512 mlo = _mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(lo, lo)));
+        __m512 mhi = _mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(hi, hi)));
+        __m512i m16 = _mm512_packus_epi32(_mm512_cvttps_epi32(mlo), _mm512_cvttps_epi32(mhi));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtusepi16_epi8(m16));
+    }
+    horizontal_span(vs, vd, i, n, dst);
+}
+#endif
+
+static sobel_row_fn sobel_row;
+
+void sobel_bind(isa_level level) {
+    switch (level) {
+#ifdef ISA_X86
+    case ISA_AVX512: sobel_row = row_avx512; break;
+    case ISA_AVX2:   sobel_row = row_avx2; break;
+    case ISA_SSE41:  sobel_row = row_sse41; break;
+#endif
+    default:         sobel_row = row_scalar; break;
+    }
+}
+
+int sobel_rows(const image_view* in, int y0, int rows, const image_view* out) {
+    int n = in->width * 3, height = in->height, failed = 0;
+    cpu_dispatch_init();
+
+    #pragma omp parallel
+    {
+        int16_t* vs = malloc((size_t)(n + 6) * sizeof(int16_t));
+        int16_t* vd = malloc((size_t)(n + 6) * sizeof(int16_t));
+
+        // a thread without buffers still takes part in the loop, but skips its rows
+        #pragma omp for schedule(static)
+        for (int y = y0; y < y0 + rows; y++) {
+            if (!vs || !vd) {
+                #pragma omp atomic write
+                failed = 1;
+                continue;
+            }
+            const unsigned char* a = VIEW_ROW(in, y > 0 ? y - 1 : 0);
+            const unsigned char* b = VIEW_ROW(in, y);
+            const unsigned char* c = VIEW_ROW(in, y < height - 1 ? y + 1 : height - 1);
+            sobel_row(a, b, c, n, vs, vd, VIEW_ROW(out, y - y0));
+        }
+
+        free(vs);
+        free(vd);
+    }
+    return !failed;
+}
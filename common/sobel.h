@@ -0,0 +1,15 @@
+// sobel.h
+#ifndef SOBEL_H
+#define SOBEL_H
+
+#include "image_view.h"
+
+// Per-channel Sobel gradient magnitude of rows [y0, y0 + rows) of an RGB view, borders
+// clamped to the view, written to rows [0, rows) of `out`. Uses the separable form
+// ([1 2 1] x [-1 0 1]) in int16 lanes; the AVX-512, AVX2, SSE4.1 or scalar row kernel
+// is picked at run time by cpu_isa_level(). All paths match the original float loops
+// bit for bit: sqrt is exact and truncated, then saturated to 255. Returns 0 if a
+// thread's row buffers cannot be allocated.
+int sobel_rows(const image_view* in, int y0, int rows, const image_view* out);
+
+#endif
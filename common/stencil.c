@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_dispatch.h"
+#include "stencil.h"
+#ifdef ISA_X86
+#include <immintrin.h>
+#endif
+
+// Widest vector in bytes, for the emboss phase masks
+#define MAX_VEC 64
+
+static unsigned char sat_u8(int v) {
+    return (unsigned char)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+// Scalar sharpen of bytes [from, to) of a row of n bytes; the taps at x +/- 1 clamp
+static void sharpen_span(const unsigned char* up, const unsigned char* cur, const unsigned char* down,
+                         int n, int from, int to, unsigned char* dst) {
+    for (int i = from; i < to; i++) {
+        int w = (i >= 3) ? i - 3 : i;
+        int e = (i + 3 < n) ? i + 3 : i;
+        dst[i] = sat_u8(5 * cur[i] - up[i] - down[i] - cur[w] - cur[e]);
+    }
+}
+
+// Vector sharpen of the interior bytes [3, n - 3), where no horizontal tap clamps.
+// Returns the first byte it did not write. The u8 -> i16 unpacks and the saturating
+// pack both work per 128-bit lane, so bytes come back out in order at every width.
+typedef int (*sharpen_vec_fn)(const unsigned char* up, const unsigned char* cur,
+                              const unsigned char* down, int n, unsigned char* dst);
+
+static int sharpen_vec_scalar(const unsigned char* up, const unsigned char* cur,
+                              const unsigned char* down, int n, unsigned char* dst) {
+    (void)up; (void)cur; (void)down; (void)n; (void)dst;
+    return 3;
+}
+
+#ifdef ISA_X86
+ISA_TARGET("sse2")
+static int sharpen_vec_sse2(const unsigned char* up, const unsigned char* cur, const unsigned char* down,
+                            int n, unsigned char* dst) {
+    int i = 3;
+    const __m128i z = _mm_setzero_si128();
+    for (; i + 16 <= n - 3; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+        __m128i u = _mm_loadu_si128((const __m128i*)(up + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(down + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(cur + i - 3));
+        __m128i e = _mm_loadu_si128((const __m128i*)(cur + i + 3));
+        __m128i half[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i c16 = h ? _mm_unpackhi_epi8(c, z) : _mm_unpacklo_epi8(c, z);
+            __m128i ns = h ? _mm_add_epi16(_mm_unpackhi_epi8(u, z), _mm_unpackhi_epi8(d, z))
+                           : _mm_add_epi16(_mm_unpacklo_epi8(u, z), _mm_unpacklo_epi8(d, z));
+            __m128i we = h ? _mm_add_epi16(_mm_unpackhi_epi8(w, z), _mm_unpackhi_epi8(e, z))
+                           : _mm_add_epi16(_mm_unpacklo_epi8(w, z), _mm_unpacklo_epi8(e, z));
+            __m128i c5 = _mm_add_epi16(_mm_slli_epi16(c16, 2), c16);
+            half[h] = _mm_sub_epi16(c5, _mm_add_epi16(ns, we));
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(half[0], half[1]));
+    }
+    return i;
+}
+
+ISA_TARGET("avx2")
+static int sharpen_vec_avx2(const unsigned char* up, const unsigned char* cur, const unsigned char* down,
+                            int n, unsigned char* dst) {
+    int i = 3;
+    const __m256i z = _mm256_setzero_si256();
+    for (; i + 32 <= n - 3; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(cur + i));
+        __m256i u = _mm256_loadu_si256((const __m256i*)(up + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(down + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(cur + i - 3));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(cur + i + 3));
+        __m256i half[2];
+        for (int h = 0; h < 2; h++) {
+            __m256i c16 = h ? _mm256_unpackhi_epi8(c, z) : _mm256_unpacklo_epi8(c, z);
+            __m256i ns = h ? _mm256_add_epi16(_mm256_unpackhi_epi8(u, z), _mm256_unpackhi_epi8(d, z))
+                           : _mm256_add_epi16(_mm256_unpacklo_epi8(u, z), _mm256_unpacklo_epi8(d, z));
+            __m256i we = h ? _mm256_add_epi16(_mm256_unpackhi_epi8(w, z), _mm256_unpackhi_epi8(e, z))
+                           : _mm256_add_epi16(_mm256_unpacklo_epi8(w, z), _mm256_unpacklo_epi8(e, z));
+            __m256i c5 = _mm256_add_epi16(_mm256_slli_epi16(c16, 2), c16);
+            half[h] = _mm256_sub_epi16(c5, _mm256_add_epi16(ns, we));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(half[0], half[1]));
+    }
+    return i;
+}
+
+ISA_TARGET("avx512f,avx512bw")
+static int sharpen_vec_avx512(const unsigned char* up, const unsigned char* cur, const unsigned char* down,
+                              int n, unsigned char* dst) {
+    int i = 3;
+    const __m512i z = _mm512_setzero_si512();
+    for (; i + 64 <= n - 3; i += 64) {
+        __m512i c = _mm512_loadu_si512(cur + i), u = _mm512_loadu_si512(up + i);
+        __m512i d = _mm512_loadu_si512(down + i);
+        __m512i w = _mm512_loadu_si512(cur + i - 3), e = _mm512_loadu_si512(cur + i + 3);
+        __m512i half[2];
+        for (int h = 0; h < 2; h++) {
+            __m512i c16 = h ? _mm512_unpackhi_epi8(c, z) : _mm512_unpacklo_epi8(c, z);
+            __m512i ns = h ? _mm512_add_epi16(_mm512_unpackhi_epi8(u, z), _mm512_unpackhi_epi8(d, z))
+                           : _mm512_add_epi16(_mm512_unpacklo_epi8(u, z), _mm512_unpacklo_epi8(d, z));
+            __m512i we = h ? _mm512_add_epi16(_mm512_unpackhi_epi8(w, z), _mm512_unpackhi_epi8(e, z))
+                           : _mm512_add_epi16(_mm512_unpacklo_epi8(w, z), _mm512_unpacklo_epi8(e, z));
+            __m512i c5 = _mm512_add_epi16(_mm512_slli_epi16(c16, 2), c16);
+            half[h] = _mm512_sub_epi16(c5, _mm512_add_epi16(ns, we));
+        }
+        _mm512_storeu_si512(dst + i, _mm512_packus_epi16(half[0], half[1]));
+    }
+    return i;
+}
+#endif
+
+static sharpen_vec_fn sharpen_vec;
+
+int sharpen_rows(const image_view* in, int y0, int rows, const image_view* out) {
+    int n = in->width * 3, height = in->height;
+    cpu_dispatch_init();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = y0; y < y0 + rows; y++) {
+        const unsigned char* up = VIEW_ROW(in, y > 0 ? y - 1 : 0);
+        const unsigned char* cur = VIEW_ROW(in, y);
+        const unsigned char* down = VIEW_ROW(in, y < height - 1 ? y + 1 : height - 1);
+        unsigned char* dst = VIEW_ROW(out, y - y0);
+
+        sharpen_span(up, cur, down, n, 0, 3, dst);
+        int i = sharpen_vec(up, cur, down, n, dst);
+        sharpen_span(up, cur, down, n, i, n, dst);
+    }
+    return 1;
+}
+
+// Scalar emboss of pixels [from, to), from >= 1, against the row above
+static void emboss_span(const unsigned char* prev, const unsigned char* cur, int from, int to,
+                        unsigned char* dst) {
+    for (int x = from; x < to; x++) {
+        const unsigned char* p = cur + x * 3;
+        const unsigned char* q = prev + (x - 1) * 3;
+        int dr = p[0] - q[0], dg = p[1] - q[1], db = p[2] - q[2];
+        int m = dr;
+        if (abs(dg) > abs(m)) m = dg;
+        if (abs(db) > abs(m)) m = db;
+        dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = sat_u8(128 + m);
+    }
+}
+
+// Vector emboss from byte 3 (pixel 1) on, entirely in u8 lanes. Each lane takes its
+// byte as a red channel with green and blue one and two bytes on, so the lanes at red
+// bytes hold full pixels: |d| and its sign come from saturating subtractions, the
+// channel with the strictly larger |d| wins, and 128 +/- |d| saturates on its own.
+// Those values are then shifted one and two bytes on (carrying across vectors) into
+// the green and blue bytes. pm[p] + s holds 0xFF at the bytes of phase p for a vector
+// starting at phase s. Returns the first byte it did not write.
+typedef int (*emboss_vec_fn)(const unsigned char* prev, const unsigned char* cur, int n,
+                             unsigned char pm[3][MAX_VEC + 2], unsigned char* dst);
+
+static int emboss_vec_scalar(const unsigned char* prev, const unsigned char* cur, int n,
+                             unsigned char pm[3][MAX_VEC + 2], unsigned char* dst) {
+    (void)prev; (void)cur; (void)n; (void)pm; (void)dst;
+    return 3;
+}
+
+#ifdef ISA_X86
+ISA_TARGET("sse2")
+static int emboss_vec_sse2(const unsigned char* prev, const unsigned char* cur, int n,
+                           unsigned char pm[3][MAX_VEC + 2], unsigned char* dst) {
+    int i = 3;
+    const __m128i z = _mm_setzero_si128(), k128 = _mm_set1_epi8((char)128);
+    __m128i last = z;
+    for (; i + 16 + 2 <= n; i += 16) {
+        __m128i mag[3], nonneg[3];
+        for (int c = 0; c < 3; c++) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(cur + i + c));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prev + i - 3 + c));
+            __m128i down = _mm_subs_epu8(b, a);
+            mag[c] = _mm_or_si128(_mm_subs_epu8(a, b), down);
+            nonneg[c] = _mm_cmpeq_epi8(down, z);
+        }
+        __m128i m = mag[0], pos = nonneg[0];
+        for (int c = 1; c < 3; c++) {
+            __m128i keep = _mm_cmpeq_epi8(_mm_subs_epu8(mag[c], m), z);
+            m = _mm_or_si128(_mm_and_si128(keep, m), _mm_andnot_si128(keep, mag[c]));
+            pos = _mm_or_si128(_mm_and_si128(keep, pos), _mm_andnot_si128(keep, nonneg[c]));
+        }
+        __m128i v = _mm_or_si128(_mm_and_si128(pos, _mm_adds_epu8(k128, m)),
+                                 _mm_andnot_si128(pos, _mm_subs_epu8(k128, m)));
+
+        __m128i sh1 = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(last, 15));
+        __m128i sh2 = _mm_or_si128(_mm_slli_si128(v, 2), _mm_srli_si128(last, 14));
+        last = v;
+        int s = i % 3;
+        __m128i m0 = _mm_loadu_si128((const __m128i*)(pm[0] + s));
+        __m128i m1 = _mm_loadu_si128((const __m128i*)(pm[1] + s));
+        __m128i m2 = _mm_loadu_si128((const __m128i*)(pm[2] + s));
+        v = _mm_or_si128(_mm_and_si128(v, m0), _mm_or_si128(_mm_and_si128(sh1, m1), _mm_and_si128(sh2, m2)));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+    return i;
+}
+
+ISA_TARGET("avx2")
+static int emboss_vec_avx2(const unsigned char* prev, const unsigned char* cur, int n,
+                           unsigned char pm[3][MAX_VEC + 2], unsigned char* dst) {
+    int i = 3;
+    const __m256i z = _mm256_setzero_si256(), k128 = _mm256_set1_epi8((char)128);
+    __m256i last = z;
+    for (; i + 32 + 2 <= n; i += 32) {
+        __m256i mag[3], nonneg[3];
+        for (int c = 0; c < 3; c++) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(cur + i + c));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(prev + i - 3 + c));
+            __m256i down = _mm256_subs_epu8(b, a);
+            mag[c] = _mm256_or_si256(_mm256_subs_epu8(a, b), down);
+            nonneg[c] = _mm256_cmpeq_epi8(down, z);
+        }
+        __m256i m = mag[0], pos = nonneg[0];
+        for (int c = 1; c < 3; c++) {
+            __m256i keep = _mm256_cmpeq_epi8(_mm256_subs_epu8(mag[c], m), z);
+            m = _mm256_blendv_epi8(mag[c], m, keep);
+            pos = _mm256_blendv_epi8(nonneg[c], pos, keep);
+        }
+        __m256i v = _mm256_blendv_epi8(_mm256_subs_epu8(k128, m), _mm256_adds_epu8(k128, m), pos);
+
+        __m256i t = _mm256_permute2x128_si256(v, last, 0x03);
+        __m256i sh1 = _mm256_alignr_epi8(v, t, 15), sh2 = _mm256_alignr_epi8(v, t, 14);
+        last = v;
+        int s = i % 3;
+        v = _mm256_blendv_epi8(v, sh1, _mm256_loadu_si256((const __m256i*)(pm[1] + s)));
+        v = _mm256_blendv_epi8(v, sh2, _mm256_loadu_si256((const __m256i*)(pm[2] + s)));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+    return i;
+}
+
+ISA_TARGET("avx512f,avx512bw")
+static int emboss_vec_avx512(const unsigned char* prev, const unsigned char* cur, int n,
+                             unsigned char pm[3][MAX_VEC + 2], unsigned char* dst) {
+    int i = 3;
+    const __m512i z = _mm512_setzero_si512(), k128 = _mm512_set1_epi8((char)128);
+    const unsigned long long red = 0x9249249249249249ULL;  // every third bit from bit 0
+    __m512i last = z;
+    (void)pm;
+    for (; i + 64 + 2 <= n; i += 64) {
+        __m512i mag[3];
+        __mmask64 nonneg[3];
+        for (int c = 0; c < 3; c++) {
+            __m512i a = _mm512_loadu_si512(cur + i + c), b = _mm512_loadu_si512(prev + i - 3 + c);
+            __m512i down = _mm512_subs_epu8(b, a);
+            mag[c] = _mm512_or_si512(_mm512_subs_epu8(a, b), down);
+            nonneg[c] = _mm512_cmpeq_epi8_mask(down, z);
+        }
+        __m512i m = mag[0];
+        __mmask64 pos = nonneg[0];
+        for (int c = 1; c < 3; c++) {
+            __mmask64 keep = _mm512_cmpeq_epi8_mask(_mm512_subs_epu8(mag[c], m), z);
+            m = _mm512_mask_blend_epi8(keep, mag[c], m);
+            pos = (keep & pos) | (~keep & nonneg[c]);
+        }
+        __m512i v = _mm512_mask_blend_epi8(pos, _mm512_subs_epu8(k128, m), _mm512_adds_epu8(k128, m));
+
+        // t holds the previous 16 bytes under each 128-bit lane, for the lane-wise alignr
+        __m512i t = _mm512_alignr_epi64(v, last, 6);
+        __m512i sh1 = _mm512_alignr_epi8(v, t, 15), sh2 = _mm512_alignr_epi8(v, t, 14);
+        last = v;
+        int s = i % 3;
+        v = _mm512_mask_blend_epi8(red << ((4 - s) % 3), v, sh1);
+        v = _mm512_mask_blend_epi8(red << ((5 - s) % 3), v, sh2);
+        _mm512_storeu_si512(dst + i, v);
+    }
+    return i;
+}
+#endif
+
+static emboss_vec_fn emboss_vec;
+
+void stencil_bind(isa_level level) {
+    switch (level) {
+#ifdef ISA_X86
+    case ISA_AVX512: sharpen_vec = sharpen_vec_avx512; emboss_vec = emboss_vec_avx512; break;
+    case ISA_AVX2:   sharpen_vec = sharpen_vec_avx2;   emboss_vec = emboss_vec_avx2; break;
+    // SSE2 is all either needs
+    case ISA_SSE41:  sharpen_vec = sharpen_vec_sse2;   emboss_vec = emboss_vec_sse2; break;
+#endif
+    default:         sharpen_vec = sharpen_vec_scalar; emboss_vec = emboss_vec_scalar; break;
+    }
+}
+
+int emboss_rows(const image_view* in, int y0, int rows, const image_view* out) {
+    int width = in->width, n = width * 3;
+    cpu_dispatch_init();
+
+    unsigned char pm[3][MAX_VEC + 2];
+    for (int p = 0; p < 3; p++)
+        for (int k = 0; k < MAX_VEC + 2; k++)
+            pm[p][k] = (k % 3 == p) ? 0xFF : 0;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = y0; y < y0 + rows; y++) {
+        unsigned char* dst = VIEW_ROW(out, y - y0);
+        if (y == 0) {
+            memset(dst, 128, n);
+            continue;
+        }
+        const unsigned char* prev = VIEW_ROW(in, y - 1);
+        const unsigned char* cur = VIEW_ROW(in, y);
+
+        dst[0] = dst[1] = dst[2] = 128;
+        int i = emboss_vec(prev, cur, n, pm, dst);
+        emboss_span(prev, cur, i / 3, width, dst);
+    }
+    return 1;
+}
@@ -0,0 +1,23 @@
+// stencil.h
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include "image_view.h"
+
+// 8-bit stencils on RGB views. Both work on rows [y0, y0 + rows) of `in`, treating the
+// view's edges as the image edges, and write rows [0, rows) of `out`. Interiors run 16, 32 or 64
+// bytes at a time (SSE2, AVX2 or AVX-512BW, picked at run time by cpu_isa_level()).
+// Edges and tails use scalar code, and every path gives the same bytes as the original
+// per-pixel loops. Both return 1: they allocate nothing, but report like every other
+// row kernel so the filters can pass a failure on.
+
+// Sharpen: 5c - n - s - e - w per channel, borders clamped, saturated to [0, 255].
+// Vectors widen to 16-bit lanes and pack back with unsigned saturation.
+int sharpen_rows(const image_view* in, int y0, int rows, const image_view* out);
+
+// Emboss: 128 + the signed channel difference to the upper-left pixel with the largest
+// magnitude (red wins ties, then green), written to all three channels. The first
+// row and column are neutral grey (128). Vectors stay in u8 lanes throughout.
+int emboss_rows(const image_view* in, int y0, int rows, const image_view* out);
+
+#endif
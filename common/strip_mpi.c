@@ -0,0 +1,1532 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include "strip_mpi.h"
+#include "utils.h"
+#include "pnm_mpi.h"
+#include "png_mpi.h"
+#include "rowcodec.h"
+#include "pngenc.h"
+
+void strip_rows(int height, int rank, int size, int* first, int* rows) {
+    int per = height / size, extra = height % size;
+    *first = rank * per + (rank < extra ? rank : extra);
+    *rows = per + (rank < extra ? 1 : 0);
+}
+
+void strip_bounds(int height, int size, const double* weights, int* bound) {
+    double total = 0.0;
+    for (int r = 0; weights && r < size; r++) {
+        if (!(weights[r] > 0.0) || !isfinite(weights[r])) weights = NULL;
+        else total += weights[r];
+    }
+    if (!weights) {
+        for (int r = 0; r < size; r++) {
+            int rows;
+            strip_rows(height, r, size, &bound[r], &rows);
+        }
+        bound[size] = height;
+        return;
+    }
+
+    // each boundary rounds the weight before it, then keeps a row for every rank on
+    // either side
+    double acc = 0.0;
+    bound[0] = 0;
+    for (int r = 1; r < size; r++) {
+        acc += weights[r - 1];
+        int b = (int)floor(height * (acc / total) + 0.5);
+        int lo = bound[r - 1] + 1, hi = height - (size - r);
+        bound[r] = b < lo ? lo : (b > hi ? hi : b);
+    }
+    bound[size] = height;
+}
+
+// Row split of one strip decomposition across `size` ranks: rank r owns rows
+// [bound[r], bound[r + 1]), as strip_bounds lays them out
+typedef struct {
+    int height, size;
+    int* bound;
+} strip_plan;
+
+static void strip_plan_init(strip_plan* p, int height, int size, const double* weights,
+                            MPI_Comm comm) {
+    p->height = height;
+    p->size = size;
+    p->bound = malloc((size_t)(size + 1) * sizeof(int));
+    if (!p->bound) {
+        fprintf(stderr, "Out of memory for the strip layout\n");
+        MPI_Abort(comm, 1);
+    }
+    strip_bounds(height, size, weights, p->bound);
+}
+
+static void strip_plan_free(strip_plan* p) {
+    free(p->bound);
+    p->bound = NULL;
+}
+
+static void plan_rows(const strip_plan* p, int r, int* first, int* rows) {
+    *first = p->bound[r];
+    *rows = p->bound[r + 1] - p->bound[r];
+}
+
+// Rank owning image row y (needs height >= size)
+static int row_owner(int y, const strip_plan* p) {
+    int lo = 0, hi = p->size - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (p->bound[mid] <= y) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Halo rows above and below image rows [first, first + rows): only the rows inside the
+// image unless `periodic`, when the image wraps and both halos are full
+static void span_halo(int height, int first, int rows, int halo, int periodic, int* top,
+                      int* bottom) {
+    int below = height - first - rows;
+    *top = periodic ? halo : (first < halo ? first : halo);
+    *bottom = periodic ? halo : (below < halo ? below : halo);
+}
+
+// Halo rows above and below rank r's own
+static void halo_depth(const strip_plan* p, int r, int halo, int periodic, int* top,
+                       int* bottom) {
+    int first, rows;
+    plan_rows(p, r, &first, &rows);
+    span_halo(p->height, first, rows, halo, periodic, top, bottom);
+}
+
+// A run of halo rows one rank needs from another: image rows [src_row, src_row + rows)
+// of `peer` land at local rows [dst_row, dst_row + rows) of the receiver's buffer
+typedef struct {
+    int peer, src_row, dst_row, rows;
+} halo_segment;
+
+// Where rank r's halo rows come from, laid out as in halo_depth. Fills `seg` (room
+// for top + bottom entries) and returns the segment count.
+static int halo_segments(const strip_plan* p, int r, int halo, int periodic, halo_segment* seg,
+                         int* top, int* bottom) {
+    int first, rows, height = p->height;
+    plan_rows(p, r, &first, &rows);
+    halo_depth(p, r, halo, periodic, top, bottom);
+
+    int n = 0;
+    for (int part = 0; part < 2; part++) {
+        int dst = part ? *top + rows : 0, count = part ? *bottom : *top;
+        int g0 = part ? first + rows : first - *top;
+        for (int i = 0; i < count; i++) {
+            int g = ((g0 + i) % height + height) % height;
+            int owner = row_owner(g, p);
+            if (n > 0 && seg[n - 1].peer == owner &&
+                seg[n - 1].dst_row + seg[n - 1].rows == dst + i &&
+                seg[n - 1].src_row + seg[n - 1].rows == g) {
+                seg[n - 1].rows++;
+            } else {
+                seg[n] = (halo_segment){ owner, g, dst + i, 1 };
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+// Halo messages in flight between halo_exchange_start and halo_exchange_finish
+typedef struct {
+    MPI_Request* req;
+    int count;
+} halo_exchange;
+
+// Room for one more request in `x`, doubling `*cap` when full
+static void halo_exchange_reserve(halo_exchange* x, int* cap, int rank, MPI_Comm comm) {
+    if (x->count < *cap) return;
+    MPI_Request* req = realloc(x->req, (size_t)(*cap * 2) * sizeof(MPI_Request));
+    if (!req) {
+        fprintf(stderr, "Rank %d: out of memory for the halo exchange\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    x->req = req;
+    *cap *= 2;
+}
+
+// Start filling the halo rows of `local` (laid out as in halo_segments) from the ranks
+// that own them. Every rank derives every other rank's segments, so no sizes are
+// exchanged; the segment index is the message tag. Rows this rank owns itself (wrap-
+// around on one rank) are copied straight away.
+static void halo_exchange_start(halo_exchange* x, unsigned char* local, size_t row_bytes,
+                                const strip_plan* p, int halo, int periodic, MPI_Datatype row,
+                                MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int first, rows, top, bottom;
+    plan_rows(p, rank, &first, &rows);
+
+    halo_segment* seg = malloc((size_t)(2 * halo + 1) * sizeof(halo_segment));
+    int cap = 2 * size + 2;
+    x->req = malloc((size_t)cap * sizeof(MPI_Request));
+    x->count = 0;
+    if (!seg || !x->req) {
+        fprintf(stderr, "Rank %d: out of memory for the halo exchange\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    // what this rank receives, posted before any send
+    int n = halo_segments(p, rank, halo, periodic, seg, &top, &bottom);
+    for (int k = 0; k < n; k++) {
+        unsigned char* dst = local + (size_t)seg[k].dst_row * row_bytes;
+        if (seg[k].peer == rank) {
+            memcpy(dst, local + (size_t)(top + seg[k].src_row - first) * row_bytes,
+                   (size_t)seg[k].rows * row_bytes);
+            continue;
+        }
+        halo_exchange_reserve(x, &cap, rank, comm);
+        MPI_Irecv(dst, seg[k].rows, row, seg[k].peer, k, comm, &x->req[x->count++]);
+    }
+
+    // what every other rank needs from this one
+    for (int q = 0; q < size; q++) {
+        if (q == rank) continue;
+        int qtop, qbottom;
+        int m = halo_segments(p, q, halo, periodic, seg, &qtop, &qbottom);
+        for (int k = 0; k < m; k++) {
+            if (seg[k].peer != rank) continue;
+            halo_exchange_reserve(x, &cap, rank, comm);
+            MPI_Isend(local + (size_t)(top + seg[k].src_row - first) * row_bytes, seg[k].rows,
+                      row, q, k, comm, &x->req[x->count++]);
+        }
+    }
+    free(seg);
+}
+
+static void halo_exchange_finish(halo_exchange* x) {
+    MPI_Waitall(x->count, x->req, MPI_STATUSES_IGNORE);
+    free(x->req);
+    x->req = NULL;
+}
+
+// An image with fewer rows than `comm` has ranks leaves the ranks past its last row
+// without a strip, and the collective steps assume every rank has one. Those ranks sit
+// the filter out: `*active` gets a communicator of the first `height` ranks, which run
+// it, and MPI_COMM_NULL on the others. Returns whether this rank is active.
+static int rows_comm(int height, MPI_Comm comm, MPI_Comm* active) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split(comm, rank < height ? 0 : MPI_UNDEFINED, rank, active);
+    return *active != MPI_COMM_NULL;
+}
+
+// End of a rows_comm run: every rank of `comm` gets the active ranks' verdict
+static int rows_comm_done(int ok, MPI_Comm comm, MPI_Comm* active) {
+    if (*active != MPI_COMM_NULL) MPI_Comm_free(active);
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    return ok;
+}
+
+// Row counts and first rows of every rank's strip, allocated on the root only
+static void strip_layout(const strip_plan* p, MPI_Comm comm, int** counts, int** displs) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    *counts = *displs = NULL;
+    if (rank != 0) return;
+    *counts = malloc(size * sizeof(int));
+    *displs = malloc(size * sizeof(int));
+    if (!*counts || !*displs) {
+        fprintf(stderr, "Rank 0: out of memory for the strip layout\n");
+        MPI_Abort(comm, 1);
+    }
+    for (int i = 0; i < size; i++)
+        plan_rows(p, i, &(*displs)[i], &(*counts)[i]);
+}
+
+mpi_output mpi_output_for(const char* output_path, output_mode to_root) {
+    mpi_output o = { to_root, NULL, NULL };
+    if (output_path && pnm_is_ppm_path(output_path)) {
+        o.mode = OUTPUT_PPM;
+        o.path = output_path;
+    } else if (output_path && png_is_png_path(output_path) && to_root == OUTPUT_GATHER) {
+        // a PNG the ranks encode themselves replaces the gather; put and packed assembly
+        // still bring the image to the root for the caller's encoder
+        o.mode = OUTPUT_PNG;
+        o.path = output_path;
+    }
+    return o;
+}
+
+int parse_output_mode(const char* name, output_mode* mode) {
+    if (strcmp(name, "gather") == 0) *mode = OUTPUT_GATHER;
+    else if (strcmp(name, "put") == 0) *mode = OUTPUT_PUT;
+    else if (strcmp(name, "packed") == 0) *mode = OUTPUT_PACKED;
+    else return 0;
+    return 1;
+}
+
+static output_mode mode_of(const mpi_output* output) {
+    return output ? output->mode : OUTPUT_GATHER;
+}
+
+// The root's output image as an RMA window, which every rank puts its finished rows
+// into during one passive-target epoch. MPI allocates the window memory, which every
+// one-sided component accepts (shared memory on a node, RDMA between nodes).
+typedef struct {
+    MPI_Win win;
+    unsigned char* base;   // root only
+    size_t bytes;
+} put_target;
+
+// Collective: opens the window over an image of `bytes` bytes on the root
+static void put_target_open(put_target* t, size_t bytes, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    t->bytes = bytes;
+    MPI_Win_allocate(rank == 0 ? (MPI_Aint)bytes : 0, 1, MPI_INFO_NULL, comm, &t->base,
+                     &t->win);
+    MPI_Win_lock_all(0, t->win);
+}
+
+// Put `count` items of `src_type` from `src` at byte `at` of the root's image, where
+// they land as `count` items of `dst_type`. `src` must stay untouched until
+// put_target_close.
+static void put_target_put(put_target* t, const void* src, int count, MPI_Datatype src_type,
+                           MPI_Aint at, MPI_Datatype dst_type) {
+    if (count > 0) MPI_Put(src, count, src_type, 0, at, count, dst_type, t->win);
+}
+
+// Collective: ends the epoch, which completes this rank's puts, and once every rank
+// has, copies the whole image out of the window into a new `*out` on the root (NULL
+// elsewhere, and everywhere if any rank's filter failed). Returns the verdict on every
+// rank.
+static int put_target_close(put_target* t, int ok, MPI_Comm comm, unsigned char** out) {
+    int rank, all_ok;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Win_unlock_all(t->win);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    *out = NULL;
+    if (all_ok && rank == 0) {
+        *out = malloc(t->bytes);
+        if (!*out) {
+            fprintf(stderr, "Rank 0: out of memory for the output image\n");
+            MPI_Abort(comm, 1);
+        }
+        // a lock on its own window makes the puts visible to the root's loads
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, t->win);
+        memcpy(*out, t->base, t->bytes);
+        MPI_Win_unlock(0, t->win);
+    }
+    MPI_Win_free(&t->win);
+    return all_ok;
+}
+
+// Root side of gather_packed: posts the receive of rank `r`'s rows, as described by
+// its entry in `meta`, into a new `*in`
+static void post_packed_recv(const long long* meta, int r, MPI_Comm comm,
+                             unsigned char** in, MPI_Request* req) {
+    const long long* m = meta + 4 * r;
+    size_t n = m[3] < 0 ? (size_t)m[1] * (size_t)m[2] : (size_t)m[3];
+    *in = malloc(n ? n : 1);
+    if (!*in) {
+        fprintf(stderr, "Rank 0: out of memory for the packed rows\n");
+        MPI_Abort(comm, 1);
+    }
+    if (m[3] < 0) {
+        // whole rows, so a strip past an int count of bytes still fits one message
+        MPI_Datatype rrow;
+        MPI_Type_contiguous((int)m[2], MPI_UNSIGNED_CHAR, &rrow);
+        MPI_Type_commit(&rrow);
+        MPI_Irecv(*in, (int)m[1], rrow, r, 0, comm, req);
+        MPI_Type_free(&rrow);
+    } else {
+        MPI_Irecv(*in, (int)n, MPI_UNSIGNED_CHAR, r, 0, comm, req);
+    }
+}
+
+// Collective: every rank compresses its `rows` rows of `row_bytes` bytes at `src`
+// (`stride` apart) and sends them to the root, which decompresses each rank's rows
+// into a new `*out` of `image_bytes` bytes, from byte `at` on and `out_stride` apart.
+// A rank whose rows do not shrink, or whose stream would pass an int count, sends
+// them raw. Returns the verdict on every rank (0 only if a stream fails to decode).
+static int gather_packed(const unsigned char* src, int rows, size_t row_bytes, size_t stride,
+                         size_t at, size_t out_stride, size_t image_bytes,
+                         const mpi_output* output, MPI_Comm comm, unsigned char** out) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    size_t raw = (size_t)rows * row_bytes;
+    unsigned char* buf = malloc(row_pack_bound(rows, row_bytes));
+    if (!buf) {
+        fprintf(stderr, "Rank %d: out of memory for the packed rows\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    double start = MPI_Wtime();
+    size_t packed = rank == 0 ? raw : row_pack(src, rows, row_bytes, stride, buf);
+    int stored = packed >= raw || packed > INT_MAX;
+    if (stored && rank != 0)
+        for (int y = 0; y < rows; y++)
+            memcpy(buf + (size_t)y * row_bytes, src + (size_t)y * stride, row_bytes);
+    double pack_seconds = MPI_Wtime() - start, slowest;
+    MPI_Reduce(&pack_seconds, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    // where each rank's rows go and how they travel: a packed size, or -1 for raw rows
+    long long mine[4] = { (long long)at, rows, (long long)row_bytes,
+                          stored ? -1 : (long long)packed }, *meta = NULL;
+    if (rank == 0) {
+        meta = malloc((size_t)size * sizeof(mine));
+        if (!meta) {
+            fprintf(stderr, "Rank 0: out of memory for the packed layout\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gather(mine, 4, MPI_LONG_LONG, meta, 4, MPI_LONG_LONG, 0, comm);
+
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+    int ok = 1;
+    if (rank != 0) {
+        if (stored) MPI_Send(buf, rows, row, 0, 0, comm);
+        else MPI_Send(buf, (int)packed, MPI_UNSIGNED_CHAR, 0, 0, comm);
+    } else {
+        *out = malloc(image_bytes);
+        if (!*out) {
+            fprintf(stderr, "Rank 0: out of memory for the output image\n");
+            MPI_Abort(comm, 1);
+        }
+        for (int y = 0; y < rows; y++)
+            memcpy(*out + at + (size_t)y * out_stride, src + (size_t)y * stride, row_bytes);
+
+        // one stream at a time, each unpacked while the next is still arriving
+        double raw_bytes = 0.0, sent_bytes = 0.0, unpack_seconds = 0.0;
+        unsigned char* in[2] = { NULL, NULL };
+        MPI_Request req[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+        if (size > 1) post_packed_recv(meta, 1, comm, &in[1], &req[1]);
+        for (int r = 1; r < size; r++) {
+            long long* m = meta + 4 * r;
+            int rrows = (int)m[1];
+            size_t rbytes = (size_t)m[2], n = m[3] < 0 ? (size_t)rrows * rbytes : (size_t)m[3];
+            MPI_Wait(&req[r % 2], MPI_STATUS_IGNORE);
+            if (r + 1 < size)
+                post_packed_recv(meta, r + 1, comm, &in[(r + 1) % 2], &req[(r + 1) % 2]);
+
+            double t = MPI_Wtime();
+            unsigned char* dst = *out + (size_t)m[0];
+            if (m[3] < 0) {
+                for (int y = 0; y < rrows; y++)
+                    memcpy(dst + (size_t)y * out_stride, in[r % 2] + (size_t)y * rbytes, rbytes);
+            } else if (!row_unpack(in[r % 2], n, rrows, rbytes, out_stride, dst)) {
+                fprintf(stderr, "Rank 0: packed rows from rank %d do not decode\n", r);
+                ok = 0;
+            }
+            unpack_seconds += MPI_Wtime() - t;
+            raw_bytes += (double)rrows * (double)rbytes;
+            sent_bytes += (double)n;
+            free(in[r % 2]);
+            in[r % 2] = NULL;
+        }
+        if (output && output->stats)
+            *output->stats = (transfer_stats){ raw_bytes, sent_bytes, slowest, unpack_seconds };
+        if (!ok) {
+            free(*out);
+            *out = NULL;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    MPI_Type_free(&row);
+    free(meta);
+    free(buf);
+    return ok;
+}
+
+// Hand on every rank's filtered strip, if every rank's filter succeeded: written
+// straight into the PPM, encoded into the PNG, put (already done, `put` is closed
+// here) or gathered on the root. Collective; returns the verdict on every rank.
+static int finish_strips(const unsigned char* local_out, int first, int rows, int ok, int width,
+                         const strip_plan* plan, MPI_Datatype row, const mpi_output* output,
+                         put_target* put, MPI_Comm comm, unsigned char** out) {
+    if (mode_of(output) == OUTPUT_PUT) return put_target_close(put, ok, comm, out);
+
+    int rank, all_ok;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    *out = NULL;
+    if (!all_ok) return 0;
+    if (mode_of(output) == OUTPUT_PPM)
+        return pnm_write_block_mpi(output->path, width, plan->height, 0, first, width, rows,
+                                   local_out, (size_t)width * 3, comm);
+    if (mode_of(output) == OUTPUT_PNG)
+        return png_write_rows_mpi(output->path, width, plan->height, first, rows, local_out,
+                                  (size_t)width * 3, png_level(), comm);
+    if (mode_of(output) == OUTPUT_PACKED)
+        return gather_packed(local_out, rows, (size_t)width * 3, (size_t)width * 3,
+                             (size_t)first * width * 3, (size_t)width * 3,
+                             (size_t)plan->height * width * 3, output, comm, out);
+
+    int *counts, *displs;
+    strip_layout(plan, comm, &counts, &displs);
+    if (rank == 0) {
+        *out = malloc((size_t)plan->height * width * 3);
+        if (!*out) {
+            fprintf(stderr, "Rank 0: out of memory for the output image\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gatherv(local_out, rows, row, *out, counts, displs, row, 0, comm);
+    free(counts);
+    free(displs);
+    return 1;
+}
+
+int mpi_filter_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                      const double* weights, const unsigned char* img, int* width, int* height,
+                      MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                      double* seconds) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int dims[2] = { *width, *height };
+    MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+    *width = dims[0];
+    *height = dims[1];
+    *out = NULL;
+    if (dims[1] < size) {
+        MPI_Comm active;
+        int ok = 0;
+        *seconds = 0.0;
+        if (dims[1] > 0 && rows_comm(dims[1], comm, &active))
+            ok = mpi_filter_strips(kind, smooth, num_threads, weights, img, width, height,
+                                   active, output, out, seconds);
+        return dims[1] > 0 && rows_comm_done(ok, comm, &active);
+    }
+    size_t row_bytes = (size_t)dims[0] * 3;
+
+    // counts are in rows, so images past 2 GB still fit the int counts
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // only a wrapping Gaussian needs rows from the far end of the image; every other
+    // border is rebuilt from the rows at the image edge
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP &&
+                   smooth->method != GAUSSIAN_BOX && smooth->method != GAUSSIAN_BOX3;
+    strip_plan plan;
+    strip_plan_init(&plan, dims[1], size, weights, comm);
+    int first, rows, top, bottom;
+    plan_rows(&plan, rank, &first, &rows);
+    halo_depth(&plan, rank, halo, periodic, &top, &bottom);
+
+    // this rank's rows plus halos, O(height / size) rather than the whole image
+    unsigned char* local = malloc((size_t)(top + rows + bottom) * row_bytes);
+    unsigned char* local_out = malloc((size_t)rows * row_bytes);
+    if (!local || !local_out) {
+        fprintf(stderr, "Rank %d: out of memory for the image strips\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    int *counts, *displs;
+    strip_layout(&plan, comm, &counts, &displs);
+    MPI_Scatterv(img, counts, displs, row, local + (size_t)top * row_bytes, rows, row, 0, comm);
+    free(counts);
+    free(displs);
+
+    // Rows at least `halo` away from a halo depend on owned rows only: filter them from
+    // a view of the owned rows while the halos are in flight, then the rows next to the
+    // halos once they have arrived
+    int lo = top ? halo : 0, hi = rows - (bottom ? halo : 0);
+    if (lo >= hi) lo = hi = 0;
+
+    int put = mode_of(output) == OUTPUT_PUT;
+    put_target target;
+    if (put) put_target_open(&target, (size_t)dims[1] * row_bytes, comm);
+    MPI_Aint at = (MPI_Aint)first * (MPI_Aint)row_bytes;
+
+    double start = MPI_Wtime();
+    halo_exchange x;
+    halo_exchange_start(&x, local, row_bytes, &plan, halo, periodic, row, comm);
+
+    image_view in = image_view_packed(local, dims[0], top + rows + bottom);
+    image_view dst = image_view_packed(local_out, dims[0], rows);
+    int ok = 1;
+    if (lo < hi) {
+        image_view owned = image_view_sub(&in, 0, top, dims[0], rows);
+        image_view part = image_view_sub(&dst, 0, lo, dims[0], hi - lo);
+        hpc_exec_ctx exec = { num_threads, lo, hi - lo };
+        ok = hpc_filter_run(kind, &owned, &part, smooth, &exec);
+        if (put && ok)
+            put_target_put(&target, part.data, hi - lo, row, at + (MPI_Aint)(lo * row_bytes),
+                           row);
+    }
+    halo_exchange_finish(&x);
+
+    if (lo == hi) {
+        hpc_exec_ctx exec = { num_threads, top, rows };
+        ok = hpc_filter_run(kind, &in, &dst, smooth, &exec);
+    } else {
+        image_view below = image_view_sub(&dst, 0, hi, dims[0], rows - hi);
+        hpc_exec_ctx above_rows = { num_threads, top, lo };
+        hpc_exec_ctx below_rows = { num_threads, top + hi, rows - hi };
+        if (lo > 0) ok = ok && hpc_filter_run(kind, &in, &dst, smooth, &above_rows);
+        if (hi < rows) ok = ok && hpc_filter_run(kind, &in, &below, smooth, &below_rows);
+    }
+    if (put && ok) {
+        put_target_put(&target, local_out, lo, row, at, row);
+        put_target_put(&target, local_out + (size_t)hi * row_bytes, rows - hi, row,
+                       at + (MPI_Aint)(hi * row_bytes), row);
+    }
+    *seconds = MPI_Wtime() - start;
+    free(local);
+
+    int all_ok = finish_strips(local_out, first, rows, ok, dims[0], &plan, row, output,
+                               put ? &target : NULL, comm, out);
+    MPI_Type_free(&row);
+    strip_plan_free(&plan);
+    free(local_out);
+    return all_ok;
+}
+
+int mpi_filter_pnm_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                          const double* weights, const char* path, int* width, int* height,
+                          MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                          double* seconds) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    *out = NULL;
+
+    pnm_header h;
+    if (!pnm_read_header_mpi(path, &h, comm)) return 0;
+    *width = h.width;
+    *height = h.height;
+    if (h.height < size) {
+        MPI_Comm active;
+        int ok = 0;
+        *seconds = 0.0;
+        if (rows_comm(h.height, comm, &active))
+            ok = mpi_filter_pnm_strips(kind, smooth, num_threads, weights, path, width, height,
+                                       active, output, out, seconds);
+        return rows_comm_done(ok, comm, &active);
+    }
+    size_t row_bytes = (size_t)h.width * 3;
+
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // halos are read from the file along with the own rows, wrapping past the image
+    // ends for a periodic Gaussian, so there is nothing to exchange
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP &&
+                   smooth->method != GAUSSIAN_BOX && smooth->method != GAUSSIAN_BOX3;
+    strip_plan plan;
+    strip_plan_init(&plan, h.height, size, weights, comm);
+    int first, rows, top, bottom;
+    plan_rows(&plan, rank, &first, &rows);
+    halo_depth(&plan, rank, halo, periodic, &top, &bottom);
+
+    unsigned char* local = malloc((size_t)(top + rows + bottom) * row_bytes);
+    unsigned char* local_out = malloc((size_t)rows * row_bytes);
+    if (!local || !local_out) {
+        fprintf(stderr, "Rank %d: out of memory for the image strips\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    if (!pnm_read_rows_mpi(path, &h, first - top, top + rows + bottom, local, comm)) {
+        if (rank == 0) fprintf(stderr, "Error reading image rows from %s\n", path);
+        MPI_Type_free(&row);
+        strip_plan_free(&plan);
+        free(local);
+        free(local_out);
+        return 0;
+    }
+
+    int put = mode_of(output) == OUTPUT_PUT;
+    put_target target;
+    if (put) put_target_open(&target, (size_t)h.height * row_bytes, comm);
+
+    double start = MPI_Wtime();
+    image_view in = image_view_packed(local, h.width, top + rows + bottom);
+    image_view dst = image_view_packed(local_out, h.width, rows);
+    hpc_exec_ctx exec = { num_threads, top, rows };
+    int ok = hpc_filter_run(kind, &in, &dst, smooth, &exec);
+    if (put && ok)
+        put_target_put(&target, local_out, rows, row, (MPI_Aint)first * (MPI_Aint)row_bytes, row);
+    *seconds = MPI_Wtime() - start;
+    free(local);
+
+    int all_ok = finish_strips(local_out, first, rows, ok, h.width, &plan, row, output,
+                               put ? &target : NULL, comm, out);
+    MPI_Type_free(&row);
+    strip_plan_free(&plan);
+    free(local_out);
+    return all_ok;
+}
+
+// Whether a rows x cols grid leaves every block at least `halo` deep wherever a halo is
+// exchanged, so that blocks take their halos from direct neighbours only
+static int grid_fits(int width, int height, int rows, int cols, int halo, int periodic) {
+    int min = halo > 1 ? halo : 1;
+    if (width / cols < ((cols > 1 || periodic) ? min : 1)) return 0;
+    return height / rows >= ((rows > 1 || periodic) ? min : 1);
+}
+
+int mpi_block_grid(int width, int height, int size, int halo, int periodic) {
+    // internal block edges are what the halo exchange moves: (rows - 1) cuts of the full
+    // width plus (cols - 1) cuts of the full height. Ties keep fewer columns, whose
+    // blocks stay contiguous in memory.
+    int best = 1;
+    double best_cost = (double)(size - 1) * width;
+    for (int cols = 2; cols <= size; cols++) {
+        if (size % cols) continue;
+        int brows = size / cols;
+        if (!grid_fits(width, height, brows, cols, halo, periodic)) continue;
+        double cost = (double)(brows - 1) * width + (double)(cols - 1) * height;
+        if (cost < best_cost) {
+            best = cols;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// Bytes of `rows` rows of `row_bytes` bytes each, `stride` apart
+static MPI_Datatype block_type(int rows, size_t row_bytes, size_t stride) {
+    MPI_Datatype t;
+    MPI_Type_vector(rows, (int)row_bytes, (int)stride, MPI_UNSIGNED_CHAR, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
+
+// mpi_filter_blocks over the image at `img` on the root, or, with a `pnm` header, over the
+// PPM/PGM file at `path`, which every rank reads its own block of
+static int filter_blocks(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                         int grid_cols, const double* weights, const unsigned char* img,
+                         const char* path, const pnm_header* pnm, int* width, int* height,
+                         MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                         double* seconds) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int dims[2] = { *width, *height };
+    if (pnm) {
+        dims[0] = pnm->width;
+        dims[1] = pnm->height;
+    } else {
+        MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+    }
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP &&
+                   smooth->method != GAUSSIAN_BOX && smooth->method != GAUSSIAN_BOX3;
+    // rank weights size row strips, and only strips encode a PNG in parallel, so either
+    // leaves the automatic choice at strips
+    if (grid_cols <= 0)
+        grid_cols = weights || mode_of(output) == OUTPUT_PNG
+                        ? 1 : mpi_block_grid(dims[0], dims[1], size, halo, periodic);
+    if (grid_cols == 1)
+        return pnm ? mpi_filter_pnm_strips(kind, smooth, num_threads, weights, path, width,
+                                           height, comm, output, out, seconds)
+                   : mpi_filter_strips(kind, smooth, num_threads, weights, img, width, height,
+                                       comm, output, out, seconds);
+
+    *width = dims[0];
+    *height = dims[1];
+    *out = NULL;
+    if (size % grid_cols) return 0;
+    int grid[2] = { size / grid_cols, grid_cols }, periods[2] = { periodic, periodic };
+    if (!grid_fits(dims[0], dims[1], grid[0], grid[1], halo, periodic)) return 0;
+
+    // rank order is kept, so the root of `comm` is rank 0 of the grid too
+    MPI_Comm cart;
+    MPI_Cart_create(comm, 2, grid, periods, 0, &cart);
+    int coords[2], north, south, west, east;
+    MPI_Cart_coords(cart, rank, 2, coords);
+    MPI_Cart_shift(cart, 0, 1, &north, &south);
+    MPI_Cart_shift(cart, 1, 1, &west, &east);
+
+    // own block, and a halo on every side that has a neighbour (all sides when the
+    // image wraps); the other sides are image edges the filter borders itself
+    int y0, bh, x0, bw;
+    strip_rows(dims[1], coords[0], grid[0], &y0, &bh);
+    strip_rows(dims[0], coords[1], grid[1], &x0, &bw);
+    int top = north != MPI_PROC_NULL ? halo : 0, bottom = south != MPI_PROC_NULL ? halo : 0;
+    int left = west != MPI_PROC_NULL ? halo : 0, right = east != MPI_PROC_NULL ? halo : 0;
+    int lw = left + bw + right, lh = top + bh + bottom;
+    size_t lstride = (size_t)lw * 3;
+
+    unsigned char* local = malloc((size_t)lh * lstride);
+    unsigned char* local_out = malloc((size_t)bh * lstride);
+    if (!local || !local_out) {
+        fprintf(stderr, "Rank %d: out of memory for the image blocks\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    unsigned char* own = local + (size_t)top * lstride + (size_t)left * 3;
+    MPI_Datatype own_type = block_type(bh, (size_t)bw * 3, lstride);
+
+    MPI_Request* req = malloc((size_t)(size + 1) * sizeof(MPI_Request));
+    if (!req) {
+        fprintf(stderr, "Rank %d: out of memory for the block requests\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    if (pnm) {
+        // every rank reads its own block straight from the file
+        if (!pnm_read_block_mpi(path, pnm, x0, y0, bw, bh, own, lstride, cart)) {
+            MPI_Type_free(&own_type);
+            MPI_Comm_free(&cart);
+            free(req);
+            free(local);
+            free(local_out);
+            return 0;
+        }
+    } else {
+        // the root sends each rank its own block straight out of the image
+        MPI_Irecv(own, 1, own_type, 0, 0, cart, &req[size]);
+        if (rank == 0) {
+            for (int r = 0; r < size; r++) {
+                int c[2], ry0, rbh, rx0, rbw;
+                MPI_Cart_coords(cart, r, 2, c);
+                strip_rows(dims[1], c[0], grid[0], &ry0, &rbh);
+                strip_rows(dims[0], c[1], grid[1], &rx0, &rbw);
+                MPI_Datatype t = block_type(rbh, (size_t)rbw * 3, (size_t)dims[0] * 3);
+                MPI_Isend(img + ((size_t)ry0 * dims[0] + rx0) * 3, 1, t, r, 0, cart, &req[r]);
+                MPI_Type_free(&t);
+            }
+            MPI_Waitall(size + 1, req, MPI_STATUSES_IGNORE);
+        } else {
+            MPI_Wait(&req[size], MPI_STATUS_IGNORE);
+        }
+    }
+
+    int put = mode_of(output) == OUTPUT_PUT;
+    put_target target;
+    if (put) put_target_open(&target, (size_t)dims[1] * dims[0] * 3, cart);
+
+    double start = MPI_Wtime();
+
+    // columns first, over the own rows only, then whole local rows including the column
+    // halos just received, which fills the corners. Tags name the direction of travel,
+    // so a rank that is its own neighbour (one block across a wrapping image) matches.
+    MPI_Request ex[4];
+    MPI_Datatype cols = block_type(bh, (size_t)halo * 3, lstride);
+    unsigned char* band = local + (size_t)top * lstride;
+    MPI_Irecv(band, 1, cols, west, 1, cart, &ex[0]);
+    MPI_Irecv(band + (size_t)(left + bw) * 3, 1, cols, east, 0, cart, &ex[1]);
+    MPI_Isend(band + (size_t)left * 3, 1, cols, west, 0, cart, &ex[2]);
+    MPI_Isend(band + (size_t)(left + bw - halo) * 3, 1, cols, east, 1, cart, &ex[3]);
+    MPI_Waitall(4, ex, MPI_STATUSES_IGNORE);
+    MPI_Type_free(&cols);
+
+    int n = halo * lw * 3;
+    MPI_Irecv(local, n, MPI_UNSIGNED_CHAR, north, 1, cart, &ex[0]);
+    MPI_Irecv(local + (size_t)(top + bh) * lstride, n, MPI_UNSIGNED_CHAR, south, 0, cart, &ex[1]);
+    MPI_Isend(band, n, MPI_UNSIGNED_CHAR, north, 0, cart, &ex[2]);
+    MPI_Isend(local + (size_t)(top + bh - halo) * lstride, n, MPI_UNSIGNED_CHAR, south, 1, cart,
+              &ex[3]);
+    MPI_Waitall(4, ex, MPI_STATUSES_IGNORE);
+
+    // the filter runs over the full local width; the halo columns of the result are dropped
+    image_view in = image_view_packed(local, lw, lh);
+    image_view dst = image_view_packed(local_out, lw, bh);
+    hpc_exec_ctx exec = { num_threads, top, bh };
+    int ok = hpc_filter_run(kind, &in, &dst, smooth, &exec);
+    if (put && ok) {
+        MPI_Datatype t = block_type(bh, (size_t)bw * 3, (size_t)dims[0] * 3);
+        put_target_put(&target, local_out + (size_t)left * 3, 1, own_type,
+                       ((MPI_Aint)y0 * dims[0] + x0) * 3, t);
+        MPI_Type_free(&t);
+    }
+    *seconds = MPI_Wtime() - start;
+    free(local);
+
+    int all_ok;
+    if (put) {
+        all_ok = put_target_close(&target, ok, cart, out);
+    } else {
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, cart);
+    }
+    if (all_ok && mode_of(output) == OUTPUT_PPM) {
+        all_ok = pnm_write_block_mpi(output->path, dims[0], dims[1], x0, y0, bw, bh,
+                                     local_out + (size_t)left * 3, lstride, cart);
+    } else if (all_ok && mode_of(output) == OUTPUT_PACKED) {
+        all_ok = gather_packed(local_out + (size_t)left * 3, bh, (size_t)bw * 3, lstride,
+                               ((size_t)y0 * dims[0] + x0) * 3, (size_t)dims[0] * 3,
+                               (size_t)dims[1] * dims[0] * 3, output, cart, out);
+    } else if (all_ok && !put) {
+        if (rank == 0) {
+            *out = malloc((size_t)dims[1] * dims[0] * 3);
+            if (!*out) {
+                fprintf(stderr, "Rank 0: out of memory for the output image\n");
+                MPI_Abort(comm, 1);
+            }
+            for (int r = 0; r < size; r++) {
+                int c[2], ry0, rbh, rx0, rbw;
+                MPI_Cart_coords(cart, r, 2, c);
+                strip_rows(dims[1], c[0], grid[0], &ry0, &rbh);
+                strip_rows(dims[0], c[1], grid[1], &rx0, &rbw);
+                MPI_Datatype t = block_type(rbh, (size_t)rbw * 3, (size_t)dims[0] * 3);
+                MPI_Irecv(*out + ((size_t)ry0 * dims[0] + rx0) * 3, 1, t, r, 1, cart, &req[r]);
+                MPI_Type_free(&t);
+            }
+        }
+        MPI_Send(local_out + (size_t)left * 3, 1, own_type, 0, 1, cart);
+        if (rank == 0) MPI_Waitall(size, req, MPI_STATUSES_IGNORE);
+    }
+
+    MPI_Type_free(&own_type);
+    MPI_Comm_free(&cart);
+    free(req);
+    free(local_out);
+    return all_ok;
+}
+
+int mpi_filter_blocks(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                      int grid_cols, const double* weights, const unsigned char* img,
+                      int* width, int* height, MPI_Comm comm, const mpi_output* output,
+                      unsigned char** out, double* seconds) {
+    return filter_blocks(kind, smooth, num_threads, grid_cols, weights, img, NULL, NULL, width,
+                         height, comm, output, out, seconds);
+}
+
+// The ranks of a communicator grouped by node: `ranks` renumbers them so that every
+// node's ranks are consecutive (the root stays rank 0), `node` holds the ranks sharing
+// memory with this one, and `leaders` the lowest rank of every node (MPI_COMM_NULL on
+// the others)
+typedef struct {
+    MPI_Comm ranks, node, leaders;
+    int node_rank, node_size;
+    int node_first_rank;   // rank in `ranks` of this node's leader
+} node_layout;
+
+static void node_layout_init(node_layout* n, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &n->node);
+    MPI_Comm_rank(n->node, &n->node_rank);
+    MPI_Comm_size(n->node, &n->node_size);
+    MPI_Comm_split(comm, n->node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &n->leaders);
+
+    // nodes follow the order of their leaders, so the root's node comes first
+    int first = 0;
+    if (n->leaders != MPI_COMM_NULL) {
+        int leader_rank;
+        MPI_Comm_rank(n->leaders, &leader_rank);
+        MPI_Exscan(&n->node_size, &first, 1, MPI_INT, MPI_SUM, n->leaders);
+        if (leader_rank == 0) first = 0;
+    }
+    MPI_Bcast(&first, 1, MPI_INT, 0, n->node);
+    n->node_first_rank = first;
+    MPI_Comm_split(comm, 0, first + n->node_rank, &n->ranks);
+}
+
+static void node_layout_free(node_layout* n) {
+    MPI_Comm_free(&n->ranks);
+    MPI_Comm_free(&n->node);
+    if (n->leaders != MPI_COMM_NULL) MPI_Comm_free(&n->leaders);
+}
+
+// Whether any node of `comm` runs more than one of its ranks
+static int ranks_share_nodes(MPI_Comm comm) {
+    MPI_Comm node;
+    int rank, node_size, most;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    MPI_Comm_size(node, &node_size);
+    MPI_Comm_free(&node);
+    MPI_Allreduce(&node_size, &most, 1, MPI_INT, MPI_MAX, comm);
+    return most > 1;
+}
+
+// Root side of filling the leaders' node buffers from a decoded image: each leader's
+// rows [start, start + count), wrapping past the image ends, as up to one message per
+// contiguous run. The root copies its own node's rows into `own`.
+static void send_node_rows(const unsigned char* img, int start, int count, int height,
+                           size_t row_bytes, MPI_Datatype row, unsigned char* own,
+                           MPI_Comm leaders) {
+    int nleaders;
+    MPI_Comm_size(leaders, &nleaders);
+    int* range = malloc((size_t)nleaders * 2 * sizeof(int));
+    if (!range) {
+        fprintf(stderr, "Rank 0: out of memory for the node layout\n");
+        MPI_Abort(leaders, 1);
+    }
+    int mine[2] = { start, count };
+    MPI_Gather(mine, 2, MPI_INT, range, 2, MPI_INT, 0, leaders);
+    for (int l = 0; l < nleaders; l++) {
+        for (int i = 0, run = 0; i < range[2 * l + 1]; run++) {
+            int g = ((range[2 * l] + i) % height + height) % height;
+            int n = (range[2 * l + 1] - i < height - g) ? range[2 * l + 1] - i : height - g;
+            if (l == 0)
+                memcpy(own + (size_t)i * row_bytes, img + (size_t)g * row_bytes,
+                       (size_t)n * row_bytes);
+            else
+                MPI_Send(img + (size_t)g * row_bytes, n, row, l, run, leaders);
+            i += n;
+        }
+    }
+    free(range);
+}
+
+// Leader side of send_node_rows
+static void recv_node_rows(int start, int count, int height, size_t row_bytes,
+                           MPI_Datatype row, unsigned char* dst, MPI_Comm leaders) {
+    int mine[2] = { start, count };
+    MPI_Gather(mine, 2, MPI_INT, NULL, 2, MPI_INT, 0, leaders);
+    for (int i = 0, run = 0; i < count; run++) {
+        int g = ((start + i) % height + height) % height;
+        int n = (count - i < height - g) ? count - i : height - g;
+        MPI_Recv(dst + (size_t)i * row_bytes, n, row, 0, run, leaders, MPI_STATUS_IGNORE);
+        i += n;
+    }
+}
+
+int mpi_filter_node_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                           const double* weights, const char* path, int* width, int* height,
+                           MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                           double* seconds) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    *out = NULL;
+
+    // PPM/PGM inputs are read by the leaders, anything else is decoded on the root
+    pnm_header h = { 0, 0, 0, 0 };
+    int pnm = pnm_read_header_mpi(path, &h, comm);
+    unsigned char* img = NULL;
+    int dims[2] = { h.width, h.height };
+    node_layout nl;
+    node_layout_init(&nl, comm);
+    int rank;
+    MPI_Comm_rank(nl.ranks, &rank);
+    if (!pnm) {
+        if (rank == 0) {
+            img = load_image(path, &dims[0], &dims[1]);
+            if (!img) dims[0] = dims[1] = 0;
+        }
+        MPI_Bcast(dims, 2, MPI_INT, 0, nl.ranks);
+    }
+    *width = dims[0];
+    *height = dims[1];
+    if (dims[1] < size) {   // no image, or fewer rows than ranks
+        stbi_image_free(img);
+        node_layout_free(&nl);
+        MPI_Comm active;
+        int ok = 0;
+        *seconds = 0.0;
+        if (dims[1] > 0 && rows_comm(dims[1], comm, &active))
+            ok = mpi_filter_node_strips(kind, smooth, num_threads, weights, path, width, height,
+                                        active, output, out, seconds);
+        return dims[1] > 0 && rows_comm_done(ok, comm, &active);
+    }
+    size_t row_bytes = (size_t)dims[0] * 3;
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // weights follow their ranks into the node-by-node numbering
+    double* node_weights = NULL;
+    if (weights) {
+        int comm_rank;
+        MPI_Comm_rank(comm, &comm_rank);
+        node_weights = malloc((size_t)size * sizeof(double));
+        if (!node_weights) {
+            fprintf(stderr, "Rank %d: out of memory for the strip weights\n", comm_rank);
+            MPI_Abort(comm, 1);
+        }
+        MPI_Allgather(&weights[comm_rank], 1, MPI_DOUBLE, node_weights, 1, MPI_DOUBLE, nl.ranks);
+    }
+    strip_plan plan;
+    strip_plan_init(&plan, dims[1], size, node_weights, comm);
+    free(node_weights);
+
+    // this rank's strip as in mpi_filter_strips, and its node's strips taken together
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP &&
+                   smooth->method != GAUSSIAN_BOX && smooth->method != GAUSSIAN_BOX3;
+    int first, rows, top, bottom;
+    plan_rows(&plan, rank, &first, &rows);
+    halo_depth(&plan, rank, halo, periodic, &top, &bottom);
+    int node_first, node_top, node_last, node_last_rows, node_bottom, unused;
+    plan_rows(&plan, nl.node_first_rank, &node_first, &unused);
+    halo_depth(&plan, nl.node_first_rank, halo, periodic, &node_top, &unused);
+    plan_rows(&plan, nl.node_first_rank + nl.node_size - 1, &node_last, &node_last_rows);
+    halo_depth(&plan, nl.node_first_rank + nl.node_size - 1, halo, periodic, &unused,
+               &node_bottom);
+    strip_plan_free(&plan);
+    int node_rows = node_last + node_last_rows - node_first;
+    int in_rows = node_top + node_rows + node_bottom;
+
+    // one input and one output buffer per node, allocated by its leader and mapped by
+    // every rank on the node
+    int leader = nl.node_rank == 0;
+    unsigned char *in_base, *out_base;
+    MPI_Win in_win, out_win;
+    MPI_Aint bytes;
+    int disp;
+    MPI_Win_allocate_shared(leader ? (MPI_Aint)in_rows * (MPI_Aint)row_bytes : 0, 1, MPI_INFO_NULL,
+                            nl.node, &in_base, &in_win);
+    MPI_Win_shared_query(in_win, 0, &bytes, &disp, &in_base);
+    MPI_Win_allocate_shared(leader ? (MPI_Aint)node_rows * (MPI_Aint)row_bytes : 0, 1,
+                            MPI_INFO_NULL, nl.node, &out_base, &out_win);
+    MPI_Win_shared_query(out_win, 0, &bytes, &disp, &out_base);
+
+    // only the leaders move input between nodes
+    int ok = 1;
+    MPI_Win_fence(0, in_win);
+    if (leader) {
+        if (pnm)
+            ok = pnm_read_rows_mpi(path, &h, node_first - node_top, in_rows, in_base, nl.leaders);
+        else if (rank == 0)
+            send_node_rows(img, node_first - node_top, in_rows, dims[1], row_bytes, row, in_base,
+                           nl.leaders);
+        else
+            recv_node_rows(node_first - node_top, in_rows, dims[1], row_bytes, row, in_base,
+                           nl.leaders);
+    }
+    MPI_Win_fence(0, in_win);
+    stbi_image_free(img);
+    MPI_Bcast(&ok, 1, MPI_INT, 0, nl.node);
+
+    // with OUTPUT_PUT the leaders put their node's strip into the root's image
+    int put = mode_of(output) == OUTPUT_PUT;
+    put_target target;
+    if (put && leader) put_target_open(&target, (size_t)dims[1] * row_bytes, nl.leaders);
+
+    // every rank filters its rows, halos included, straight out of the node's input into
+    // the node's output
+    double start = MPI_Wtime();
+    MPI_Win_fence(0, out_win);
+    if (ok) {
+        size_t offset = (size_t)(first - top - (node_first - node_top)) * row_bytes;
+        image_view in = image_view_packed(in_base + offset, dims[0], top + rows + bottom);
+        image_view dst = image_view_packed(out_base + (size_t)(first - node_first) * row_bytes,
+                                           dims[0], rows);
+        hpc_exec_ctx exec = { num_threads, top, rows };
+        ok = hpc_filter_run(kind, &in, &dst, smooth, &exec);
+    }
+    MPI_Win_fence(0, out_win);
+    if (put && leader)
+        put_target_put(&target, out_base, node_rows, row,
+                       (MPI_Aint)node_first * (MPI_Aint)row_bytes, row);
+    *seconds = MPI_Wtime() - start;
+
+    // the leaders hand on whole node strips: put, written into the PPM or PNG, or
+    // gathered on the root
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, nl.ranks);
+    if (put && leader) {
+        all_ok = put_target_close(&target, all_ok, nl.leaders, out);
+    } else if (all_ok && leader) {
+        if (mode_of(output) == OUTPUT_PPM) {
+            all_ok = pnm_write_block_mpi(output->path, dims[0], dims[1], 0, node_first,
+                                         dims[0], node_rows, out_base, row_bytes, nl.leaders);
+        } else if (mode_of(output) == OUTPUT_PNG) {
+            all_ok = png_write_rows_mpi(output->path, dims[0], dims[1], node_first, node_rows,
+                                        out_base, row_bytes, png_level(), nl.leaders);
+        } else if (mode_of(output) == OUTPUT_PACKED) {
+            all_ok = gather_packed(out_base, node_rows, row_bytes, row_bytes,
+                                   (size_t)node_first * row_bytes, row_bytes,
+                                   (size_t)dims[1] * row_bytes, output, nl.leaders, out);
+        } else {
+            int nleaders, *counts = NULL, *displs = NULL;
+            MPI_Comm_size(nl.leaders, &nleaders);
+            if (rank == 0) {
+                counts = malloc((size_t)nleaders * sizeof(int));
+                displs = malloc((size_t)nleaders * sizeof(int));
+                *out = malloc((size_t)dims[1] * row_bytes);
+                if (!counts || !displs || !*out) {
+                    fprintf(stderr, "Rank 0: out of memory for the output image\n");
+                    MPI_Abort(comm, 1);
+                }
+            }
+            MPI_Gather(&node_rows, 1, MPI_INT, counts, 1, MPI_INT, 0, nl.leaders);
+            MPI_Gather(&node_first, 1, MPI_INT, displs, 1, MPI_INT, 0, nl.leaders);
+            MPI_Gatherv(out_base, node_rows, row, *out, counts, displs, row, 0, nl.leaders);
+            free(counts);
+            free(displs);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &all_ok, 1, MPI_INT, MPI_MIN, nl.ranks);
+    if (!all_ok) {
+        free(*out);
+        *out = NULL;
+    }
+
+    MPI_Win_free(&in_win);
+    MPI_Win_free(&out_win);
+    MPI_Type_free(&row);
+    node_layout_free(&nl);
+    return all_ok;
+}
+
+// Input of the schedules that read rows straight into their own buffers: the header of
+// a PPM/PGM, which every rank then reads from, or else the image decoded on the root
+// (returned there). `dims` ends up on every rank, 0 x 0 if the root cannot decode it.
+static unsigned char* open_input(const char* path, pnm_header* h, int* pnm, int* dims,
+                                 MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    unsigned char* img = NULL;
+    *pnm = pnm_read_header_mpi(path, h, comm);
+    dims[0] = *pnm ? h->width : 0;
+    dims[1] = *pnm ? h->height : 0;
+    if (!*pnm) {
+        if (rank == 0) {
+            img = load_image(path, &dims[0], &dims[1]);
+            if (!img) dims[0] = dims[1] = 0;
+        }
+        MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+    }
+    return img;
+}
+
+// Fill `dst` with image rows [start, start + count), wrapping past either end, from the
+// file or from the root's decoded `img`. Collective; returns 0 on every rank if the
+// file could not be read.
+static int read_input_rows(const char* path, const pnm_header* h, int pnm,
+                           const unsigned char* img, int start, int count, int height,
+                           size_t row_bytes, MPI_Datatype row, unsigned char* dst,
+                           MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (pnm) return pnm_read_rows_mpi(path, h, start, count, dst, comm);
+    if (rank == 0) send_node_rows(img, start, count, height, row_bytes, row, dst, comm);
+    else recv_node_rows(start, count, height, row_bytes, row, dst, comm);
+    return 1;
+}
+
+// Image rows of tiles [tile, tile + count) of `tile_rows` rows each; the last tile of
+// the image may be shorter
+static void tile_span(int height, int tile_rows, int tile, int count, int* first, int* rows) {
+    int end = (tile + count) * tile_rows;
+    *first = tile * tile_rows;
+    *rows = (end < height ? end : height) - *first;
+}
+
+// Each rank's share of tiles [tile0, end) is a deque in one 64-bit word: how many tiles
+// have been claimed from the front (high half) and from the back (low half). Both counts
+// only grow, by MPI_Fetch_and_op additions, so the value an addition returns tells its
+// caller exactly which tiles it got, however the owner and thieves interleave.
+#define FRONT_TILE ((int64_t)1 << 32)
+
+// Claim tiles from the deque of rank `owner`, whose share is [tile0, end): the owner
+// takes one from the front, a thief about half of what is left from the back. Returns
+// how many tiles were claimed, the first in `*tile`, or 0 once the deque is empty.
+static int claim_tiles(MPI_Win deques, int owner, int tile0, int end, int thief, int* tile) {
+    int64_t cur, add;
+    if (thief) {
+        MPI_Fetch_and_op(NULL, &cur, MPI_INT64_T, owner, 0, MPI_NO_OP, deques);
+        MPI_Win_flush(owner, deques);
+        int left = end - (int)(uint32_t)cur - (tile0 + (int)(cur >> 32));
+        if (left <= 0) return 0;
+        add = (left + 1) / 2;
+    } else {
+        add = FRONT_TILE;
+    }
+    MPI_Fetch_and_op(&add, &cur, MPI_INT64_T, owner, 0, MPI_SUM, deques);
+    MPI_Win_flush(owner, deques);
+    int head = tile0 + (int)(cur >> 32), tail = end - (int)(uint32_t)cur;
+    if (!thief) {
+        *tile = head;
+        return head < tail;
+    }
+    *tile = tail - (int)add > head ? tail - (int)add : head;
+    return tail > *tile ? tail - *tile : 0;
+}
+
+int mpi_filter_steal(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                     int tile_rows, const char* path, const mpi_output* output, int* width,
+                     int* height, MPI_Comm comm, unsigned char** out, double* seconds,
+                     int* stolen) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    *out = NULL;
+    *stolen = 0;
+
+    pnm_header h;
+    int pnm, dims[2];
+    unsigned char* img = open_input(path, &h, &pnm, dims, comm);
+    *width = dims[0];
+    *height = dims[1];
+    if (dims[1] < size) {
+        stbi_image_free(img);
+        MPI_Comm active;
+        int ok = 0;
+        *seconds = 0.0;
+        if (dims[1] > 0 && rows_comm(dims[1], comm, &active))
+            ok = mpi_filter_steal(kind, smooth, num_threads, tile_rows, path, output, width,
+                                  height, active, out, seconds, stolen);
+        return dims[1] > 0 && rows_comm_done(ok, comm, &active);
+    }
+    size_t row_bytes = (size_t)dims[0] * 3;
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    // about 16 tiles per rank by default, and at least one each
+    if (tile_rows <= 0) tile_rows = dims[1] / (16 * size);
+    if (tile_rows > dims[1] / size) tile_rows = dims[1] / size;
+    if (tile_rows < 1) tile_rows = 1;
+    int tiles = (dims[1] + tile_rows - 1) / tile_rows;
+
+    // every rank starts with an even share of the tiles, whose rows plus halos it holds
+    // in a window that thieves read the rows of stolen tiles from
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP;
+    int tile0, ntiles, first, rows, top, bottom;
+    strip_rows(tiles, rank, size, &tile0, &ntiles);
+    tile_span(dims[1], tile_rows, tile0, ntiles, &first, &rows);
+    span_halo(dims[1], first, rows, halo, periodic, &top, &bottom);
+    unsigned char* local;
+    MPI_Win inputs;
+    MPI_Win_allocate((MPI_Aint)(top + rows + bottom) * (MPI_Aint)row_bytes, 1, MPI_INFO_NULL,
+                     comm, &local, &inputs);
+    int64_t* deque;
+    MPI_Win deques;
+    MPI_Win_allocate(sizeof(int64_t), sizeof(int64_t), MPI_INFO_NULL, comm, &deque, &deques);
+    unsigned char* local_out = malloc((size_t)rows * row_bytes);
+    if (!local_out) {
+        fprintf(stderr, "Rank %d: out of memory for the image tiles\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_Win_lock_all(0, inputs);
+    MPI_Win_lock_all(0, deques);
+    int ok = read_input_rows(path, &h, pnm, img, first - top, top + rows + bottom, dims[1],
+                             row_bytes, row, local, comm);
+    stbi_image_free(img);
+    *deque = 0;
+    MPI_Win_sync(inputs);
+    MPI_Win_sync(deques);
+    MPI_Barrier(comm);
+
+    // results go straight to where they end up, from whichever rank computed them:
+    // without a fixed layout to gather, the root's image is filled with puts whatever
+    // the output mode
+    int to_file = mode_of(output) == OUTPUT_PPM;
+    put_target target;
+    MPI_File file;
+    MPI_Offset data = 0;
+    int opened = 0;
+    if (!to_file) put_target_open(&target, (size_t)dims[1] * row_bytes, comm);
+    else if (ok) ok = opened = pnm_create_mpi(output->path, dims[0], dims[1], &file, &data,
+                                              comm);
+
+    // own tiles one at a time from the front, then the back half of other ranks'
+    // deques until a full round finds every deque empty. Deques only shrink, so that
+    // round means all tiles are claimed.
+    double start = MPI_Wtime();
+    int victim = rank, misses = 0, steals = 0;
+    while (ok && misses < size) {
+        int vtile0, vntiles, tile;
+        strip_rows(tiles, victim, size, &vtile0, &vntiles);
+        int count = claim_tiles(deques, victim, vtile0, vtile0 + vntiles, victim != rank, &tile);
+        if (!count) {
+            misses++;
+            victim = (victim + 1) % size;
+            continue;
+        }
+        misses = 0;
+        if (victim != rank) steals++;
+
+        // the claimed rows plus halos, inside the owner's window
+        int a, trows, ttop, tbottom, vfirst, vrows, vtop, vbottom;
+        tile_span(dims[1], tile_rows, tile, count, &a, &trows);
+        span_halo(dims[1], a, trows, halo, periodic, &ttop, &tbottom);
+        tile_span(dims[1], tile_rows, vtile0, vntiles, &vfirst, &vrows);
+        span_halo(dims[1], vfirst, vrows, halo, periodic, &vtop, &vbottom);
+        size_t offset = (size_t)((a - ttop) - (vfirst - vtop)) * row_bytes;
+        int in_rows = ttop + trows + tbottom;
+
+        unsigned char *src = local + offset, *dst = local_out + (size_t)(a - first) * row_bytes;
+        if (victim != rank) {
+            src = malloc((size_t)in_rows * row_bytes);
+            dst = malloc((size_t)trows * row_bytes);
+            if (!src || !dst) {
+                fprintf(stderr, "Rank %d: out of memory for stolen tiles\n", rank);
+                MPI_Abort(comm, 1);
+            }
+            MPI_Get(src, in_rows, row, victim, (MPI_Aint)offset, in_rows, row, inputs);
+            MPI_Win_flush(victim, inputs);
+        }
+        image_view in = image_view_packed(src, dims[0], in_rows);
+        image_view part = image_view_packed(dst, dims[0], trows);
+        hpc_exec_ctx exec = { num_threads, ttop, trows };
+        ok = hpc_filter_run(kind, &in, &part, smooth, &exec);
+
+        if (ok && to_file) {
+            MPI_Status status;
+            int written = 0;
+            ok = MPI_File_write_at(file, data + (MPI_Offset)a * (MPI_Offset)row_bytes, dst,
+                                   trows, row, &status) == MPI_SUCCESS &&
+                 MPI_Get_count(&status, row, &written) == MPI_SUCCESS && written == trows;
+        } else if (ok) {
+            put_target_put(&target, dst, trows, row, (MPI_Aint)a * (MPI_Aint)row_bytes, row);
+            if (victim != rank) MPI_Win_flush(0, target.win);   // before dst is freed
+        }
+        if (victim != rank) {
+            free(src);
+            free(dst);
+        }
+    }
+    *seconds = MPI_Wtime() - start;
+    *stolen = steals;
+
+    // a rank that failed stops claiming, so its remaining tiles may be left undone; the
+    // verdict below covers them
+    int all_ok;
+    if (!to_file) {
+        all_ok = put_target_close(&target, ok, comm, out);
+    } else {
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+        if (opened) MPI_File_close(&file);
+        if (!all_ok && rank == 0) fprintf(stderr, "Error writing %s\n", output->path);
+    }
+    MPI_Win_unlock_all(deques);
+    MPI_Win_unlock_all(inputs);
+    MPI_Win_free(&deques);
+    MPI_Win_free(&inputs);
+    MPI_Type_free(&row);
+    free(local_out);
+    return all_ok;
+}
+
+int mpi_filter_iterate(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                       int iterations, int depth, const double* weights, const char* path,
+                       const mpi_output* output, int* width, int* height, MPI_Comm comm,
+                       unsigned char** out, double* seconds) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    *out = NULL;
+    if (iterations < 1) return 0;
+
+    pnm_header h;
+    int pnm, dims[2];
+    unsigned char* img = open_input(path, &h, &pnm, dims, comm);
+    *width = dims[0];
+    *height = dims[1];
+    if (dims[1] < size) {
+        stbi_image_free(img);
+        MPI_Comm active;
+        int ok = 0;
+        *seconds = 0.0;
+        if (dims[1] > 0 && rows_comm(dims[1], comm, &active))
+            ok = mpi_filter_iterate(kind, smooth, num_threads, iterations, depth, weights, path,
+                                    output, width, height, active, out, seconds);
+        return dims[1] > 0 && rows_comm_done(ok, comm, &active);
+    }
+    size_t row_bytes = (size_t)dims[0] * 3;
+    MPI_Datatype row;
+    MPI_Type_contiguous((int)row_bytes, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+
+    int halo = hpc_filter_halo(kind, smooth);
+    int periodic = kind == HPC_FILTER_SMOOTH && smooth->border == BORDER_WRAP;
+    strip_plan plan;
+    strip_plan_init(&plan, dims[1], size, weights, comm);
+    int first, rows, fewest = dims[1];
+    plan_rows(&plan, rank, &first, &rows);
+    for (int r = 0; r < size; r++)
+        if (plan.bound[r + 1] - plan.bound[r] < fewest) fewest = plan.bound[r + 1] - plan.bound[r];
+
+    // by default, as many passes per exchange as keep the deep halo within a quarter of
+    // the thinnest strip, where the redundant rows stay cheap next to the strip itself
+    if (depth <= 0) depth = halo ? fewest / (4 * halo) : iterations;
+    if (depth > iterations) depth = iterations;
+    if (depth < 1) depth = 1;
+    int deep = depth * halo, top, bottom;
+    halo_depth(&plan, rank, deep, periodic, &top, &bottom);
+    int span = top + rows + bottom;
+
+    // the strip plus deep halos, twice: each pass reads one copy and writes the other
+    unsigned char* cur = malloc((size_t)span * row_bytes);
+    unsigned char* next = malloc((size_t)span * row_bytes);
+    if (!cur || !next) {
+        fprintf(stderr, "Rank %d: out of memory for the image strips\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    int ok = read_input_rows(path, &h, pnm, img, first - top, span, dims[1], row_bytes, row,
+                             cur, comm);
+    stbi_image_free(img);
+
+    // Temporal blocking: after an exchange the halos are good for `depth` passes. Pass j
+    // of a block recomputes the rows its later passes will read, (passes - j) * halo
+    // beyond the strip on each side, so the band of valid rows shrinks by one halo per
+    // pass and has narrowed to the strip itself after the block's last pass. Where a halo
+    // is cut short by the image edge, the band runs to the edge and the filter's border
+    // rule applies there as it would on the whole image.
+    double start = MPI_Wtime();
+    for (int done = 0; ok && done < iterations;) {
+        int passes = iterations - done < depth ? iterations - done : depth;
+        if (done > 0) {
+            halo_exchange x;
+            halo_exchange_start(&x, cur, row_bytes, &plan, deep, periodic, row, comm);
+            halo_exchange_finish(&x);
+        }
+        for (int j = 1; ok && j <= passes; j++) {
+            int ext = (passes - j) * halo;
+            int above = top < ext ? top : ext, below = bottom < ext ? bottom : ext;
+            image_view in = image_view_packed(cur, dims[0], span);
+            image_view band = image_view_packed(next + (size_t)(top - above) * row_bytes, dims[0],
+                                                above + rows + below);
+            hpc_exec_ctx exec = { num_threads, top - above, above + rows + below };
+            ok = hpc_filter_run(kind, &in, &band, smooth, &exec);
+            unsigned char* t = cur;
+            cur = next;
+            next = t;
+        }
+        done += passes;
+        // a rank that failed must not leave the others waiting on its halos
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+    }
+    *seconds = MPI_Wtime() - start;
+
+    unsigned char* strip = cur + (size_t)top * row_bytes;
+    put_target put;
+    if (mode_of(output) == OUTPUT_PUT) {
+        put_target_open(&put, (size_t)dims[1] * row_bytes, comm);
+        if (ok) put_target_put(&put, strip, rows, row, (MPI_Aint)first * (MPI_Aint)row_bytes, row);
+    }
+    int all_ok = finish_strips(strip, first, rows, ok, dims[0], &plan, row, output, &put, comm,
+                               out);
+    free(cur);
+    free(next);
+    strip_plan_free(&plan);
+    MPI_Type_free(&row);
+    return all_ok;
+}
+
+int mpi_filter_file(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                    int grid_cols, const double* weights, const char* path,
+                    const mpi_output* output, int* width, int* height, MPI_Comm comm,
+                    unsigned char** out, double* seconds) {
+    if (grid_cols == 0 && ranks_share_nodes(comm))
+        return mpi_filter_node_strips(kind, smooth, num_threads, weights, path, width, height,
+                                      comm, output, out, seconds);
+
+    // PPM/PGM blocks, or strips, are read by every rank from the file
+    pnm_header h;
+    if (pnm_read_header_mpi(path, &h, comm))
+        return filter_blocks(kind, smooth, num_threads, grid_cols, weights, NULL, path, &h, width,
+                             height, comm, output, out, seconds);
+
+    // anything else is decoded on the root, which then hands out the blocks
+    int rank, loaded = 1;
+    MPI_Comm_rank(comm, &rank);
+    unsigned char* img = NULL;
+    if (rank == 0) {
+        img = load_image(path, width, height);
+        loaded = img != NULL;
+    }
+    MPI_Bcast(&loaded, 1, MPI_INT, 0, comm);
+    *out = NULL;
+    if (!loaded) return 0;
+    int ok = mpi_filter_blocks(kind, smooth, num_threads, grid_cols, weights, img, width, height,
+                               comm, output, out, seconds);
+    stbi_image_free(img);
+    return ok;
+}
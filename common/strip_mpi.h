@@ -0,0 +1,163 @@
+// strip_mpi.h
+#ifndef STRIP_MPI_H
+#define STRIP_MPI_H
+
+#include <mpi.h>
+#include "hpcfilter.h"
+
+// How a distributed filter hands on its result
+typedef enum {
+    OUTPUT_GATHER,   // MPI_Gatherv into a new image on the root once every rank is done
+    OUTPUT_PUT,      // every rank MPI_Puts its rows into the root's image as soon as they
+                     // are filtered, through an RMA window
+    OUTPUT_PPM,      // every rank writes its rows into a binary PPM file; nothing on the root
+    OUTPUT_PACKED,   // like OUTPUT_GATHER, but every rank compresses its rows (rowcodec.h)
+                     // before sending and the root decompresses them into place
+    OUTPUT_PNG       // every rank encodes its rows into its part of a PNG file (png_mpi.h)
+} output_mode;
+
+// What an OUTPUT_PACKED assembly moved, summed over the ranks that sent to the root
+typedef struct {
+    double raw_bytes;      // rows as they would have been gathered
+    double sent_bytes;     // what was sent instead
+    double pack_seconds;   // slowest rank's compression
+    double unpack_seconds; // the root's decompression
+} transfer_stats;
+
+typedef struct {
+    output_mode mode;
+    const char* path;        // OUTPUT_PPM and OUTPUT_PNG only
+    transfer_stats* stats;   // OUTPUT_PACKED: filled in on the root if not NULL
+} mpi_output;
+
+// Output for `output_path`: written in parallel if it ends in .ppm, or in .png with
+// `to_root` OUTPUT_GATHER, else assembled on the root with `to_root` (OUTPUT_GATHER,
+// OUTPUT_PUT or OUTPUT_PACKED) for the caller to encode
+mpi_output mpi_output_for(const char* output_path, output_mode to_root);
+
+// Parse "gather", "put" or "packed". Returns 0 for an unknown name.
+int parse_output_mode(const char* name, output_mode* mode);
+
+// Row split used by every MPI driver: rank `rank` of `size` owns `*rows` rows from
+// `*first`, the first height % size ranks taking one extra row
+void strip_rows(int height, int rank, int size, int* first, int* rows);
+
+// Strip boundaries for `size` ranks: rank r owns rows [bound[r], bound[r + 1]) of
+// `height` (`bound` has size + 1 entries). Without `weights` this is the strip_rows
+// split. Otherwise strips are sized in proportion to weights[r], a relative speed per
+// rank (balance_mpi.h), so that ranks of different speeds finish together; every rank
+// keeps at least one row (needs height >= size). Weights that are not all positive
+// fall back to the even split.
+void strip_bounds(int height, int size, const double* weights, int* bound);
+
+// Run one filter over an image split into row strips across `comm`, sized by
+// strip_bounds from `weights` (one per rank of `comm`; NULL splits evenly). The root
+// passes the loaded image in `img` and its size in `*width`/`*height`; the other ranks
+// pass NULL and receive the size. The root scatters each rank only its own rows, and the
+// halo rows the filter needs come from the ranks that own them, so a rank holds
+// O(height / size) rows. Each rank filters its rows with `num_threads` OpenMP threads,
+// the rows that need no halo while the halo messages are in flight. The result
+// goes where `output` says (NULL gathers it): for OUTPUT_PPM every rank writes its
+// rows straight into the file (pnm_write_block_mpi), for OUTPUT_PNG it encodes them
+// into its part of the file (png_write_rows_mpi), and `*out` is NULL; otherwise the
+// root gets the whole packed image in `*out` (malloc'd, the caller frees it). With
+// OUTPUT_PUT each part of a strip is put as soon as it is filtered, the interior rows
+// while the halos are still in flight. `*seconds` is this rank's halo exchange and
+// filtering time. An image with fewer rows than `comm` has ranks runs on the first
+// `*height` ranks only; the others get no strip and a `*seconds` of 0 (this holds for
+// every mpi_filter_* call below). Collective; returns 0 on every rank if any rank's
+// filter or the write failed, and aborts the job when a buffer cannot be allocated.
+int mpi_filter_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                      const double* weights, const unsigned char* img, int* width, int* height,
+                      MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                      double* seconds);
+
+// Same contract as mpi_filter_strips, but no rank decodes the whole image: every rank
+// reads its own rows and halos straight from the 8-bit binary PPM/PGM file at `path`
+// with collective MPI-IO (pnm_mpi.h), grey expanding to RGB. Returns 0 on every rank
+// when the file is not such an image or cannot be read.
+int mpi_filter_pnm_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                          const double* weights, const char* path, int* width, int* height,
+                          MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                          double* seconds);
+
+// Columns of the block grid mpi_filter_blocks picks for `size` ranks: the factor pair
+// with the least internal block edge (the halo rows and columns exchanged), so a wide
+// panorama splits into columns and a square image into near-square blocks. Grids whose
+// blocks would be thinner than `halo` are skipped. Returns 1 (row strips) when nothing
+// else fits.
+int mpi_block_grid(int width, int height, int size, int halo, int periodic);
+
+// Same contract as mpi_filter_strips on a 2D grid of blocks, `grid_cols` blocks across
+// and size / grid_cols down (0 picks the grid with mpi_block_grid). The ranks form an
+// MPI_Cart_create grid; the root sends each rank its block as an MPI_Type_vector, the
+// column halos go to the east/west neighbours as vectors and then the row halos, whole
+// local rows, to the north/south neighbours, which also fills the corners. Results go
+// back the same way (gathered or put), or each rank writes its block into the PPM
+// through a strided file view; a PNG's rows must be deflated in order, so for
+// OUTPUT_PNG blocks are gathered on the root instead. A one-column grid runs
+// mpi_filter_strips, the only layout `weights` apply to and the one that encodes a PNG
+// in parallel, so with weights or OUTPUT_PNG a 0 `grid_cols` picks strips. Returns 0
+// when `grid_cols` does not divide the rank count or leaves a block thinner than the
+// filter's halo.
+int mpi_filter_blocks(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                      int grid_cols, const double* weights, const unsigned char* img,
+                      int* width, int* height, MPI_Comm comm, const mpi_output* output,
+                      unsigned char** out, double* seconds);
+
+// Same contract as mpi_filter_strips for the image file at `path`, with one copy of the
+// input and one of the output per node instead of one per rank. The ranks are
+// renumbered node by node (MPI_Comm_split_type with MPI_COMM_TYPE_SHARED) so each node
+// owns consecutive strips; each rank's weight moves with it. Each node leader holds the
+// node's rows plus halos, and its share of the output, in MPI_Win_allocate_shared
+// windows. Every rank on the node filters its rows, halos included, straight from one
+// window into the other. Only the leaders move data between nodes: they read PPM/PGM
+// rows with MPI-IO or receive them from the root, which decodes anything else, and they
+// gather or put the output on the root or write it into the PPM or PNG.
+int mpi_filter_node_strips(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                           const double* weights, const char* path, int* width, int* height,
+                           MPI_Comm comm, const mpi_output* output, unsigned char** out,
+                           double* seconds);
+
+// Filter the image file at `path` across `comm`. With an automatic grid (`grid_cols` 0)
+// and several ranks on some node, this runs mpi_filter_node_strips: ranks on a node
+// share their halos through memory, so nothing is gained from blocks there. Otherwise
+// the image is split as mpi_filter_blocks(grid_cols) would: PPM/PGM files are read by
+// every rank, its own block through a strided file view (pnm_read_block_mpi) or its
+// strip with mpi_filter_pnm_strips, and anything else is decoded on the root with
+// load_image and handed out from there. The result goes where `output` says (see
+// mpi_output_for; NULL gathers it on the root), and `weights` (NULL for even) size the
+// row strips of every path. Every rank passes the same arguments. Returns 0 on every
+// rank when the file cannot be loaded or written or the filter fails.
+int mpi_filter_file(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                    int grid_cols, const double* weights, const char* path,
+                    const mpi_output* output, int* width, int* height, MPI_Comm comm,
+                    unsigned char** out, double* seconds);
+
+// mpi_filter_file for one large image whose rows cost unevenly, or ranks of uneven
+// speed: the image is cut into bands of `tile_rows` rows (0 picks about 16 per rank),
+// each rank starts with an even share of the bands and their input rows, and a rank
+// that runs out steals the back half of another rank's remaining bands, claimed with
+// MPI_Fetch_and_op on a per-rank deque and read with MPI_Get from the owner's rows.
+// Results are written into the PPM, or put into the root's image for every other
+// `output` mode (a PNG is then encoded by the caller), from wherever they were
+// computed. `*stolen` counts this rank's steals and `*seconds` its compute phase.
+// Collective.
+int mpi_filter_steal(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                     int tile_rows, const char* path, const mpi_output* output, int* width,
+                     int* height, MPI_Comm comm, unsigned char** out, double* seconds,
+                     int* stolen);
+
+// Run `kind` `iterations` times over the image at `path`, as repeated mpi_filter_file
+// calls would, but with the row strips (sized by `weights`, as in mpi_filter_strips)
+// staying on their ranks between passes. Halos are exchanged only every `depth`
+// passes, `depth` times as deep as one pass needs, and each pass also recomputes the
+// halo rows later passes of the block read; 0 picks the most passes whose halo fits in
+// a quarter of the thinnest strip. The last pass's strips go out as `output` says.
+// `*seconds` covers the passes and exchanges. Collective.
+int mpi_filter_iterate(hpc_filter_kind kind, const hpc_smooth_params* smooth, int num_threads,
+                       int iterations, int depth, const double* weights, const char* path,
+                       const mpi_output* output, int* width, int* height, MPI_Comm comm,
+                       unsigned char** out, double* seconds);
+
+#endif
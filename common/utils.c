@@ -1,7 +1,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
+#include <string.h>
 #include "utils.h"
+#include "pngenc.h"
 
 int clamp(int val) {
     return (val < 0) ? 0 : ((val > 255) ? 255 : val);
@@ -17,8 +19,47 @@ unsigned char* load_image(const char* input_path, int* width, int* height) {
 }
 
 
+int write_png(const char* output_path, const unsigned char* data, int width, int height) {
+    return png_write_file(output_path, data, width, height, (size_t)width * 3, png_level());
+}
+
+static int has_extension(const char* path, const char* ext) {
+    size_t n = strlen(path), k = strlen(ext);
+    return n >= k && strcmp(path + n - k, ext) == 0;
+}
+
+// Binary PPM, or PGM with each pixel reduced to its luma, in the same header layout as
+// the MPI writer (pnm_create_mpi)
+static int write_pnm(const char* output_path, const unsigned char* data, int width, int height,
+                     int grey) {
+    FILE* f = fopen(output_path, "wb");
+    if (!f) return 0;
+    int ok = fprintf(f, "P%d\n%d %d\n255\n", grey ? 5 : 6, width, height) > 0;
+    size_t row_bytes = (size_t)width * 3;
+    unsigned char* luma = grey ? malloc(width) : NULL;
+    if (grey && !luma) ok = 0;
+    for (int y = 0; ok && y < height; y++) {
+        const unsigned char* p = data + y * row_bytes;
+        if (!grey) {
+            ok = fwrite(p, 1, row_bytes, f) == row_bytes;
+            continue;
+        }
+        for (int x = 0; x < width; x++, p += 3)
+            luma[x] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        ok = fwrite(luma, 1, width, f) == (size_t)width;
+    }
+    free(luma);
+    return fclose(f) == 0 && ok;
+}
+
+int write_image(const char* output_path, const unsigned char* data, int width, int height) {
+    if (has_extension(output_path, ".ppm")) return write_pnm(output_path, data, width, height, 0);
+    if (has_extension(output_path, ".pgm")) return write_pnm(output_path, data, width, height, 1);
+    return write_png(output_path, data, width, height);
+}
+
 int save_image(const char* output_path, unsigned char* data, int width, int height) {
-    if (!stbi_write_png(output_path, width, height, 3, data, width * 3)) {
+    if (!write_image(output_path, data, width, height)) {
         fprintf(stderr, "Error saving image %s\n", output_path);
         return 0;
     }
@@ -31,7 +72,7 @@ void finalize_and_save(const char *filter_name, const char *output_path, unsigne
     double elapsed = (double)(end - start) / CLOCKS_PER_SEC;
     printf("%s took %.4f seconds\n", filter_name, elapsed);
 
-    if (!stbi_write_png(output_path, width, height, 3, out, width * 3)) {
+    if (!write_image(output_path, out, width, height)) {
         fprintf(stderr, "Error saving image %s\n", output_path);
     } else {
         printf("Image saved to %s\n", output_path);
@@ -46,4 +87,3 @@ void build_paths(const char* input_filename, const char* output_filename, char*
     snprintf(input_path, 512, "../inputImages/%s", input_filename);
     snprintf(output_path, 512, "../outputImages/%s", output_filename);
 }
-
@@ -1,10 +1,15 @@
 // image_utils.h
 #ifndef IMAGE_UTILS_H
 #define IMAGE_UTILS_H
+
+// Image I/O and path helpers for the executables. Not part of libhpcfilter: the
+// library works on image views and never touches files or stb.
 #include <omp.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include "filter_params.h"
 #include "../stb_image.h"
 #include "../stb_image_write.h"
 #include <time.h>
@@ -16,7 +21,14 @@ int clamp(int val);
 // Load an image from file
 unsigned char* load_image(const char* input_path, int* width, int* height);
 
-// Save an image to file
+// Encode an RGB image as PNG with the threaded encoder (pngenc.h) at png_level()
+int write_png(const char* output_path, const unsigned char* data, int width, int height);
+
+// Write an RGB image in the format its name asks for: binary PPM (P6) for ".ppm", PGM
+// (P5, Rec. 601 luma) for ".pgm", PNG (write_png) for anything else
+int write_image(const char* output_path, const unsigned char* data, int width, int height);
+
+// Save an image to file with write_image, reporting the outcome
 int save_image(const char* output_path, unsigned char* data, int width, int height);
 
 // Finalize and save for serial version
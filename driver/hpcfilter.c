@@ -0,0 +1,281 @@
+// hpcfilter.c: one driver for every filter and backend
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+#include "../common/utils.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/pngenc.h"
+#include "../common/strip_mpi.h"
+#include "../common/batch_mpi.h"
+#include "../common/balance_mpi.h"
+
+typedef enum { BACKEND_SERIAL, BACKEND_OMP, BACKEND_MPI, BACKEND_HYBRID } backend;
+
+static const char* const backend_names[] = {"serial", "omp", "mpi", "hybrid"};
+
+static void usage(const char* prog) {
+    printf("Usage: %s --filter=edges|emboss|sharpen|smooth [options] input_image output_image\n"
+           "       %s --backend=mpi|hybrid --batch=manifest [options]\n"
+           "  --backend=serial|omp|mpi|hybrid  how to run (default serial; mpi/hybrid under mpirun)\n"
+           "  --threads=N                      OpenMP threads per process for omp/hybrid (default: all)\n"
+           "  --sigma=S                        smoothing sigma (default 0.85)\n"
+           "  --method=fir|iir|box|box3|fft    smoothing method (default fir)\n"
+           "  --border=clamp|reflect|wrap|constant  smoothing border (default clamp)\n"
+           "  --grid=auto|rows|CxR             mpi/hybrid split: automatic blocks (default), row\n"
+           "                                   strips, or C blocks across by R down\n"
+           "  --assemble=gather|put|packed     mpi/hybrid: Gatherv the result on rank 0 once\n"
+           "                                   filtered (default), MPI_Put each part when done, or\n"
+           "                                   compress each part before sending it to rank 0\n"
+           "  --balance=even|calibrate|FILE    mpi/hybrid strip sizes: even (default), from a short\n"
+           "                                   timing pass, or from FILE's weights, which each run\n"
+           "                                   then updates from the measured per-rank times\n"
+           "  --schedule=static|steal          mpi/hybrid: fixed strips or blocks (default), or row\n"
+           "                                   tiles that idle ranks steal from busy ones\n"
+           "  --tile-rows=N                    rows per stolen tile (default: about 16 per rank)\n"
+           "  --iterations=K                   apply the filter K times over (default 1)\n"
+           "  --halo-depth=D                   mpi/hybrid with K > 1: passes between halo exchanges,\n"
+           "                                   over halos D times deeper (default: auto)\n"
+           "  --batch=FILE                     run every image of a manifest, one per worker rank;\n"
+           "                                   lines read: input output filter [--sigma=S ...]\n"
+           "  --isa=scalar|sse41|avx2|avx512   cap the SIMD level, like HPC_FILTER_ISA\n"
+           "  --png-level=store|fast|default|best|0-9  PNG compression, like HPC_FILTER_PNG_LEVEL\n",
+           prog, prog);
+}
+
+// Value of "--name=value" if arg is that option, else NULL
+static const char* option(const char* arg, const char* name) {
+    size_t n = strlen(name);
+    return (strncmp(arg, name, n) == 0 && arg[n] == '=') ? arg + n + 1 : NULL;
+}
+
+int main(int argc, char *argv[]) {
+    backend mode = BACKEND_SERIAL;
+    hpc_filter_kind kind = HPC_FILTER_SMOOTH;
+    hpc_smooth_params smooth = hpc_smooth_defaults();
+    int have_filter = 0, num_threads = 0, grid_cols = 0, grid_rows = 0, steal = 0, tile_rows = 0;
+    int iterations = 1, halo_depth = 0;
+    output_mode assemble = OUTPUT_GATHER;
+    const char* files[2] = {NULL, NULL};
+    const char* batch = NULL;
+    const char* balance = "even";
+    int nfiles = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* v;
+        int ok = 1;
+        if ((v = option(argv[i], "--backend"))) {
+            ok = 0;
+            for (int b = 0; b <= BACKEND_HYBRID; b++)
+                if (strcmp(v, backend_names[b]) == 0) { mode = (backend)b; ok = 1; }
+        } else if ((v = option(argv[i], "--filter"))) {
+            ok = have_filter = parse_hpc_filter(v, &kind);
+        } else if ((v = option(argv[i], "--threads"))) {
+            num_threads = atoi(v);
+            ok = num_threads > 0;
+        } else if ((v = option(argv[i], "--sigma"))) {
+            smooth.sigma = (float)atof(v);
+            ok = smooth.sigma > 0.0f;
+        } else if ((v = option(argv[i], "--method"))) {
+            ok = parse_gaussian_method(v, &smooth.method);
+        } else if ((v = option(argv[i], "--border"))) {
+            ok = parse_border_mode(v, &smooth.border);
+        } else if ((v = option(argv[i], "--grid"))) {
+            char end;
+            if (strcmp(v, "auto") == 0) grid_cols = 0;
+            else if (strcmp(v, "rows") == 0) grid_cols = 1;
+            else ok = sscanf(v, "%dx%d%c", &grid_cols, &grid_rows, &end) == 2 &&
+                      grid_cols > 0 && grid_rows > 0;
+        } else if ((v = option(argv[i], "--assemble"))) {
+            ok = parse_output_mode(v, &assemble);
+        } else if ((v = option(argv[i], "--balance"))) {
+            balance = v;
+        } else if ((v = option(argv[i], "--schedule"))) {
+            ok = strcmp(v, "static") == 0 || strcmp(v, "steal") == 0;
+            steal = strcmp(v, "steal") == 0;
+        } else if ((v = option(argv[i], "--tile-rows"))) {
+            tile_rows = atoi(v);
+            ok = tile_rows > 0;
+        } else if ((v = option(argv[i], "--iterations"))) {
+            iterations = atoi(v);
+            ok = iterations > 0;
+        } else if ((v = option(argv[i], "--halo-depth"))) {
+            halo_depth = atoi(v);
+            ok = halo_depth > 0;
+        } else if ((v = option(argv[i], "--batch"))) {
+            batch = v;
+        } else if ((v = option(argv[i], "--isa"))) {
+            isa_level level;
+            ok = parse_isa_level(v, &level) && setenv("HPC_FILTER_ISA", v, 1) == 0;
+        } else if ((v = option(argv[i], "--png-level"))) {
+            int level;
+            ok = parse_png_level(v, &level) && setenv("HPC_FILTER_PNG_LEVEL", v, 1) == 0;
+        } else if (argv[i][0] != '-' && nfiles < 2) {
+            files[nfiles++] = argv[i];
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Bad argument %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    int distributed = (mode == BACKEND_MPI || mode == BACKEND_HYBRID);
+    if (batch ? (!distributed || nfiles > 0) : (!have_filter || nfiles < 2) ||
+        (steal && iterations > 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (kind == HPC_FILTER_SMOOTH && !gaussian_border_supported(smooth.method, smooth.border)) {
+        fprintf(stderr, "Method %s supports only the clamp border\n",
+                gaussian_method_name(smooth.method));
+        return 1;
+    }
+    if (kind == HPC_FILTER_SMOOTH && !gaussian_sigma_supported(smooth.method, smooth.sigma)) {
+        fprintf(stderr, "Sigma %g is too large for method %s (use fir or iir)\n", smooth.sigma,
+                gaussian_method_name(smooth.method));
+        return 1;
+    }
+    if (num_threads == 0) num_threads = omp_get_max_threads();
+    // serial and mpi run one thread per process, omp and hybrid spread rows over threads
+    int threads = (mode == BACKEND_OMP || mode == BACKEND_HYBRID) ? num_threads : 1;
+
+    int rank = 0, size = 1;
+    if (distributed) {
+        int provided;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        if (grid_rows && grid_cols * grid_rows != size) {
+            if (rank == 0) fprintf(stderr, "Grid %dx%d needs %d processes, not %d\n", grid_cols,
+                                   grid_rows, grid_cols * grid_rows, size);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+
+    // a batch gives each worker rank whole images, so the per-image flags do not apply
+    if (batch) {
+        int jobs = 0, failed = 0;
+        double start = MPI_Wtime();
+        int ok = mpi_run_batch(batch, threads, MPI_COMM_WORLD, &jobs, &failed);
+        double total = MPI_Wtime() - start;
+        if (rank == 0 && ok)
+            printf("Batch of %d images (%d failed) on %d process%s x %d thread%s took %.3f "
+                   "seconds\n", jobs, failed, size, size == 1 ? "" : "es", threads,
+                   threads == 1 ? "" : "s", total);
+        MPI_Finalize();
+        return ok && !failed ? 0 : 1;
+    }
+
+    char input_path[512], output_path[512];
+    build_paths(files[0], files[1], input_path, output_path);
+
+    // the distributed backends load the image themselves: PPM/PGM in parallel with
+    // MPI-IO, anything else on rank 0
+    int width = 0, height = 0;
+    unsigned char *img = NULL, *out = NULL;
+    if (!distributed) {
+        img = load_image(input_path, &width, &height);
+        if (!img) return 1;
+    }
+
+    double elapsed = 0.0, total = 0.0;
+    int ok;
+    if (distributed) {
+        // uneven strips for ranks of uneven speed, measured now or over earlier runs;
+        // stealing evens out the ranks as it goes instead
+        double* weights = NULL;
+        int even = strcmp(balance, "even") == 0, calibrate = strcmp(balance, "calibrate") == 0;
+        if (!even && !steal) {
+            weights = malloc((size_t)size * sizeof(double));
+            if (!weights) MPI_Abort(MPI_COMM_WORLD, 1);
+            if (calibrate)
+                mpi_calibrate_weights(kind, &smooth, threads, 0.1, MPI_COMM_WORLD, weights);
+            else if (!mpi_read_weights(balance, MPI_COMM_WORLD, weights) && rank == 0)
+                printf("No weights for %d processes in %s, starting even\n", size, balance);
+        }
+
+        // end to end covers loading and assembling the result too, where gather and put differ
+        mpi_output output = mpi_output_for(output_path, assemble);
+        transfer_stats packed = { 0.0, 0.0, 0.0, 0.0 };
+        output.stats = &packed;
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        int stolen = 0;
+        if (steal)
+            ok = mpi_filter_steal(kind, &smooth, threads, tile_rows, input_path, &output, &width,
+                                  &height, MPI_COMM_WORLD, &out, &elapsed, &stolen);
+        else if (iterations > 1)
+            ok = mpi_filter_iterate(kind, &smooth, threads, iterations, halo_depth, weights,
+                                    input_path, &output, &width, &height, MPI_COMM_WORLD, &out,
+                                    &elapsed);
+        else
+            ok = mpi_filter_file(kind, &smooth, threads, grid_cols, weights, input_path, &output,
+                                 &width, &height, MPI_COMM_WORLD, &out, &elapsed);
+        total = MPI_Wtime() - start;
+        if (steal) {
+            int steals = 0;
+            MPI_Reduce(&stolen, &steals, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (ok && rank == 0) printf("Tiles stolen %d time%s\n", steals, steals == 1 ? "" : "s");
+        }
+        if (ok && rank == 0 && packed.raw_bytes > 0.0)
+            printf("Packed transfer: %.2f MB sent for %.2f MB of rows (%.1fx), packing %.4f s, "
+                   "unpacking %.4f s\n", packed.sent_bytes / 1e6, packed.raw_bytes / 1e6,
+                   packed.raw_bytes / (packed.sent_bytes > 0.0 ? packed.sent_bytes : 1.0),
+                   packed.pack_seconds, packed.unpack_seconds);
+
+        if (ok && weights && !calibrate) {
+            mpi_update_weights(weights, elapsed, MPI_COMM_WORLD);
+            mpi_write_weights(balance, weights, MPI_COMM_WORLD);
+        }
+        if (ok && weights && rank == 0) {
+            printf("Strip weights:");
+            for (int r = 0; r < size; r++) printf(" %.3f", weights[r]);
+            printf("\n");
+        }
+        free(weights);
+    } else {
+        // repeated passes alternate between two buffers, ending in `out`
+        out = malloc((size_t)width * height * 3);
+        unsigned char* work = iterations > 1 ? malloc((size_t)width * height * 3) : NULL;
+        hpc_exec_ctx exec = hpc_exec_defaults();
+        exec.num_threads = threads;
+        double start = omp_get_wtime();
+        ok = out && (iterations == 1 || work);
+        for (int it = 0, left = iterations; ok && it < iterations; it++, left--) {
+            unsigned char* src = it == 0 ? img : (left % 2 ? work : out);
+            image_view in = image_view_packed(src, width, height);
+            image_view dst = image_view_packed(left % 2 ? out : work, width, height);
+            ok = hpc_filter_run(kind, &in, &dst, &smooth, &exec);
+        }
+        elapsed = omp_get_wtime() - start;
+        free(work);
+    }
+
+    if (rank == 0) {
+        if (!ok) {
+            fprintf(stderr, "Filter %s failed\n", hpc_filter_name(kind));
+        } else {
+            printf("%s (%s, %d process%s x %d thread%s", hpc_filter_name(kind), backend_names[mode],
+                   size, size == 1 ? "" : "es", threads, threads == 1 ? "" : "s");
+            if (kind == HPC_FILTER_SMOOTH)
+                printf(", σ=%.2f %s %s", smooth.sigma, gaussian_method_name(smooth.method),
+                       border_mode_name(smooth.border));
+            if (iterations > 1) printf(", %d passes", iterations);
+            printf(") took %.4f seconds", elapsed);
+            if (distributed) printf(", %.4f end to end", total);
+            printf("\n");
+            // the distributed backends have already written a .ppm or .png output in parallel
+            if (out) ok = save_image(output_path, out, width, height);
+            else printf("Image saved to %s\n", output_path);
+        }
+    }
+
+    free(out);
+    stbi_image_free(img);
+    if (distributed) MPI_Finalize();
+    return ok ? 0 : 1;
+}
@@ -1,16 +1,9 @@
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <mpi.h>
 #include <omp.h>
-#include "../stb_image.h"
-#include "../stb_image_write.h"
-
-int clamp(int val) {
-    return (val < 0) ? 0 : (val > 255 ? 255 : val);
-}
+#include "../common/utils.h"
+#include "../common/strip_mpi.h"
 
 int main(int argc, char *argv[]) {
     int rank, size, provided;
@@ -32,87 +25,31 @@ int main(int argc, char *argv[]) {
     snprintf(input_path, sizeof(input_path), "../inputImages/%s", argv[1]);
     snprintf(output_path, sizeof(output_path), "../outputImages/%s", argv[2]);
 
-    int width = 0, height = 0, channels = 0;
-    unsigned char *img = NULL;
-
-    if (rank == 0) {
-        img = stbi_load(input_path, &width, &height, &channels, 3);
-        if (!img) {
-            fprintf(stderr, "Error loading %s\n", input_path);
-            MPI_Abort(MPI_COMM_WORLD, 1);
-        }
-    }
-
-    MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    int img_size = width * height * 3;
-    if (rank != 0) img = malloc(img_size);
-    MPI_Bcast(img, img_size, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
-
-    int rows_per_proc = height / size;
-    int extra = height % size;
-    int start_row = rank * rows_per_proc + (rank < extra ? rank : extra);
-    int local_rows = rows_per_proc + (rank < extra ? 1 : 0);
+    int width = 0, height = 0;
 
-    unsigned char *local_out = malloc(local_rows * width * 3);
-
-    double start = MPI_Wtime();
-
-    #pragma omp parallel for collapse(2) schedule(dynamic)
-    for (int y = 0; y < local_rows; y++) {
-        for (int x = 0; x < width; x++) {
-            int global_y = start_row + y;
-            int idx = (y * width + x) * 3;
-            if (x == 0 || global_y == 0) {
-                local_out[idx] = local_out[idx+1] = local_out[idx+2] = 128;
-            } else {
-                int ul_idx = ((global_y-1) * width + (x-1)) * 3;
-                int diff_r = img[(global_y * width + x) * 3]     - img[ul_idx];
-                int diff_g = img[(global_y * width + x) * 3 + 1] - img[ul_idx+1];
-                int diff_b = img[(global_y * width + x) * 3 + 2] - img[ul_idx+2];
-                int max_diff = diff_r;
-                if (abs(diff_g) > abs(max_diff)) max_diff = diff_g;
-                if (abs(diff_b) > abs(max_diff)) max_diff = diff_b;
-                int val = clamp(128 + max_diff);
-                local_out[idx] = local_out[idx+1] = local_out[idx+2] = (unsigned char)val;
-            }
-        }
-    }
-
-    double end = MPI_Wtime();
-
-    int *recvcounts = NULL, *displs = NULL;
+    // Each rank filters its own part of the image, read straight from the file for
+    // PPM/PGM inputs; the root gathers the result, or every rank writes its part of a
+    // .ppm or .png output
+    mpi_output output = mpi_output_for(output_path, OUTPUT_GATHER);
     unsigned char *out = NULL;
-    if (rank == 0) {
-        recvcounts = malloc(size * sizeof(int));
-        displs = malloc(size * sizeof(int));
-        out = malloc(img_size);
-        for (int i = 0; i < size; i++) {
-            int rows = rows_per_proc + (i < extra ? 1 : 0);
-            recvcounts[i] = rows * width * 3;
-            displs[i] = (i * rows_per_proc + (i < extra ? i : extra)) * width * 3;
-        }
+    double elapsed;
+    if (!mpi_filter_file(HPC_FILTER_EMBOSS, NULL, num_threads, 0, NULL, input_path, &output,
+                         &width, &height, MPI_COMM_WORLD, &out, &elapsed)) {
+        if (rank == 0) fprintf(stderr, "Embossing failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    MPI_Gatherv(local_out, local_rows * width * 3, MPI_UNSIGNED_CHAR,
-                out, recvcounts, displs, MPI_UNSIGNED_CHAR,
-                0, MPI_COMM_WORLD);
-
     if (rank == 0) {
-        printf("Embossing time: %.4f seconds\n", end - start);
-        if (!stbi_write_png(output_path, width, height, 3, out, width * 3)) {
+        printf("Embossing time: %.4f seconds\n", elapsed);
+        // a .ppm or .png output has already been written by every rank
+        if (out && !write_image(output_path, out, width, height)) {
             fprintf(stderr, "Error saving %s\n", output_path);
         } else {
             printf("Embossed image saved to %s\n", output_path);
         }
         free(out);
-        free(recvcounts);
-        free(displs);
     }
 
-    free(local_out);
-    stbi_image_free(img);
     MPI_Finalize();
     return 0;
 }
@@ -1,18 +1,9 @@
 // color_edge_openmp.c
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <omp.h>
-#include "../stb_image.h"
-#include "../stb_image_write.h"
-
-int clamp(int val, int min, int max) {
-    if (val < min) return min;
-    if (val > max) return max;
-    return val;
-}
+#include "../common/utils.h"
+#include "../common/hpcfilter.h"
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
@@ -44,64 +35,16 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    int Gx[3][3] = {
-        {-1, 0, 1},
-        {-2, 0, 2},
-        {-1, 0, 1}
-    };
-    int Gy[3][3] = {
-        {-1, -2, -1},
-        { 0,  0,  0},
-        { 1,  2,  1}
-    };
-
     double start = omp_get_wtime();
 
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float edge_r_x = 0, edge_r_y = 0;
-            float edge_g_x = 0, edge_g_y = 0;
-            float edge_b_x = 0, edge_b_y = 0;
-
-            for (int ky = -1; ky <= 1; ky++) {
-                int yy = y + ky;
-                if (yy < 0) yy = 0;
-                if (yy >= height) yy = height - 1;
-
-                for (int kx = -1; kx <= 1; kx++) {
-                    int xx = x + kx;
-                    if (xx < 0) xx = 0;
-                    if (xx >= width) xx = width - 1;
-
-                    int idx = (yy * width + xx) * 3;
-                    int kernel_x = Gx[ky + 1][kx + 1];
-                    int kernel_y = Gy[ky + 1][kx + 1];
-
-                    edge_r_x += kernel_x * img[idx];
-                    edge_r_y += kernel_y * img[idx];
-                    edge_g_x += kernel_x * img[idx + 1];
-                    edge_g_y += kernel_y * img[idx + 1];
-                    edge_b_x += kernel_x * img[idx + 2];
-                    edge_b_y += kernel_y * img[idx + 2];
-                }
-            }
-
-            int mag_r = clamp((int)sqrt(edge_r_x * edge_r_x + edge_r_y * edge_r_y), 0, 255);
-            int mag_g = clamp((int)sqrt(edge_g_x * edge_g_x + edge_g_y * edge_g_y), 0, 255);
-            int mag_b = clamp((int)sqrt(edge_b_x * edge_b_x + edge_b_y * edge_b_y), 0, 255);
-
-            int out_idx = (y * width + x) * 3;
-            out[out_idx] = (unsigned char)mag_r;
-            out[out_idx + 1] = (unsigned char)mag_g;
-            out[out_idx + 2] = (unsigned char)mag_b;
-        }
-    }
+    image_view in = image_view_packed(img, width, height);
+    image_view dst = image_view_packed(out, width, height);
+    hpc_filter_edges(&in, &dst, NULL);
 
     double end = omp_get_wtime();
     printf("Edge detection completed with %d threads in %.4f seconds\n", num_threads, end - start);
 
-    if (!stbi_write_png(output_path, width, height, 3, out, width * 3)) {
+    if (!write_image(output_path, out, width, height)) {
         fprintf(stderr, "Error saving %s\n", output_path);
     } else {
         printf("Edge detected image saved to %s\n", output_path);
@@ -1,15 +1,8 @@
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
-#include "../stb_image.h"
-#include "../stb_image_write.h"
-
-int clamp(int val) {
-    return (val < 0) ? 0 : (val > 255) ? 255 : val;
-}
+#include "../common/utils.h"
+#include "../common/hpcfilter.h"
 
 // int main with optional thread count
 int main(int argc, char *argv[]) {
@@ -47,39 +40,15 @@ int main(int argc, char *argv[]) {
     double start = omp_get_wtime();
 
     // Parallel embossing filter
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * 3;
-
-            if (x == 0 || y == 0) {
-                out[idx] = out[idx+1] = out[idx+2] = 128; // Neutral gray
-            } else {
-                // upper-left neighbor
-                int ul_idx = ((y-1) * width + (x-1)) * 3;
-
-                // differences
-                int diff_r = img[idx] - img[ul_idx];
-                int diff_g = img[idx+1] - img[ul_idx+1];
-                int diff_b = img[idx+2] - img[ul_idx+2];
-
-                // absolute difference max
-                int max_diff = diff_r;
-                if (abs(diff_g) > abs(max_diff)) max_diff = diff_g;
-                if (abs(diff_b) > abs(max_diff)) max_diff = diff_b;
-
-                // emboss effect value
-                int val = clamp(128 + max_diff);
-                out[idx] = out[idx+1] = out[idx+2] = (unsigned char)val;
-            }
-        }
-    }
+    image_view in = image_view_packed(img, width, height);
+    image_view dst = image_view_packed(out, width, height);
+    hpc_filter_emboss(&in, &dst, NULL);
 
     double end = omp_get_wtime();
     printf("Embossing completed with %d threads in %.4f seconds\n", num_threads, end - start);
 
     // Save output image
-    if (!stbi_write_png(output_path, width, height, 3, out, width * 3)) {
+    if (!write_image(output_path, out, width, height)) {
         fprintf(stderr, "Error saving %s\n", output_path);
     } else {
         printf("Embossed image saved to %s\n", output_path);
@@ -1,4 +1,5 @@
 #include "../common/utils.h"
+#include "../common/hpcfilter.h"
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
@@ -23,28 +24,11 @@ int main(int argc, char *argv[]) {
     clock_t start = clock();
 
     // Emboss filter
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * 3;
-
-            if (x == 0 || y == 0) {
-                out[idx] = out[idx + 1] = out[idx + 2] = 128;
-            } else {
-                int ul_idx = ((y - 1) * width + (x - 1)) * 3;
-
-                int diff_r = img[idx] - img[ul_idx];
-                int diff_g = img[idx + 1] - img[ul_idx + 1];
-                int diff_b = img[idx + 2] - img[ul_idx + 2];
-
-                int max_diff = diff_r;
-                if (abs(diff_g) > abs(max_diff)) max_diff = diff_g;
-                if (abs(diff_b) > abs(max_diff)) max_diff = diff_b;
-
-                int val = clamp(128 + max_diff);
-                out[idx] = out[idx + 1] = out[idx + 2] = (unsigned char)val;
-            }
-        }
-    }
+    image_view in = image_view_packed(img, width, height);
+    image_view dst = image_view_packed(out, width, height);
+    hpc_exec_ctx exec = hpc_exec_defaults();
+    exec.num_threads = 1;
+    hpc_filter_emboss(&in, &dst, &exec);
 
         finalize_and_save("embossing",output_path, out, width, height, img, start);
     return 0;
@@ -1,21 +1,38 @@
 #include "../common/utils.h"
-#include <math.h>
-
-
-// 2D Gaussian function
-float gaussian_2d(float x, float y, float sigma) {
-    return expf(-(x*x + y*y)/(2*sigma*sigma)) / (2*M_PI*sigma*sigma);
-}
+#include "../common/hpcfilter.h"
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        printf("Usage: %s input_image output_image [sigma]\n", argv[0]);
+        printf("Usage: %s input_image output_image [sigma] [fir|iir|box|box3|fft] [clamp|reflect|wrap|constant]\n", argv[0]);
         printf("Example: %s image.jpg blurred.png 1.2\n", argv[0]);
         return 1;
     }
 
     // Parameters with defaults
     float sigma = (argc > 3) ? atof(argv[3]) : 0.85f;  // Default σ = 0.85
+    gaussian_method method = GAUSSIAN_FIR;               // iir: cost independent of σ
+    if (argc > 4 && !parse_gaussian_method(argv[4], &method)) {
+        fprintf(stderr, "Unknown method %s (expected fir, iir, box, box3 or fft)\n", argv[4]);
+        return 1;
+    }
+    border_mode border = BORDER_CLAMP;
+    if (argc > 5 && !parse_border_mode(argv[5], &border)) {
+        fprintf(stderr, "Unknown border %s (expected clamp, reflect, wrap or constant)\n", argv[5]);
+        return 1;
+    }
+    if (!(sigma > 0.0f)) {
+        fprintf(stderr, "Sigma must be positive (got %s)\n", argv[3]);
+        return 1;
+    }
+    if (!gaussian_border_supported(method, border)) {
+        fprintf(stderr, "Method %s supports only the clamp border\n", gaussian_method_name(method));
+        return 1;
+    }
+    if (!gaussian_sigma_supported(method, sigma)) {
+        fprintf(stderr, "Sigma %g is too large for method %s (use fir or iir)\n", sigma,
+                gaussian_method_name(method));
+        return 1;
+    }
     char input_path[512], output_path[512];
     build_paths(argv[1], argv[2], input_path, output_path);
 
@@ -33,57 +50,20 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // gaussian kernal generation
-    int radius = (int)ceilf(3 * sigma);  // 3σ rule covers 99.7% of distribution
-    int kernel_size = 2 * radius + 1;
-    float *kernel = malloc(kernel_size * kernel_size * sizeof(float));
-    float kernel_sum = 0.0f;
-
-    // Generate kernel weights
-    for (int ky = -radius; ky <= radius; ky++) {
-        for (int kx = -radius; kx <= radius; kx++) {
-            float weight = gaussian_2d(kx, ky, sigma);
-            kernel[(ky+radius)*kernel_size + (kx+radius)] = weight;
-            kernel_sum += weight;
-        }
-    }
-
-    // Normalizing kernel
-    for (int i = 0; i < kernel_size*kernel_size; i++) {
-        kernel[i] /= kernel_sum;
-    }
-
     //filtering
     clock_t start = clock();
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
-
-            // appplying kernel 
-            for (int ky = -radius; ky <= radius; ky++) {
-                int yy = y + ky;
-                // boundary handling
-                yy = (yy < 0) ? -yy : ((yy >= height) ? 2*height - yy - 2 : yy);
-
-                for (int kx = -radius; kx <= radius; kx++) {
-                    int xx = x + kx;
-                    xx = (xx < 0) ? -xx : ((xx >= width) ? 2*width - xx - 2 : xx);
-
-                    float weight = kernel[(ky+radius)*kernel_size + (kx+radius)];
-                    int idx = (yy * width + xx) * 3;
-                    sum_r += img[idx] * weight;
-                    sum_g += img[idx+1] * weight;
-                    sum_b += img[idx+2] * weight;
-                }
-            }
-
-            // result storing
-            int out_idx = (y * width + x) * 3;
-            out[out_idx] = clamp((int)roundf(sum_r));
-            out[out_idx+1] = clamp((int)roundf(sum_g));
-            out[out_idx+2] = clamp((int)roundf(sum_b));
-        }
+    // separable kernel or recursive filter over a ghost-padded copy of the image
+    image_view in = image_view_packed(img, width, height);
+    image_view dst = image_view_packed(out, width, height);
+    hpc_smooth_params params = { sigma, method, border };
+    hpc_exec_ctx exec = hpc_exec_defaults();
+    exec.num_threads = 1;
+    if (!hpc_filter_smooth(&in, &dst, &params, &exec)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(out);
+        stbi_image_free(img);
+        return 1;
     }
 
     finalize_and_save("smoothing",output_path, out, width, height, img, start);
@@ -0,0 +1,90 @@
+// Round-trips the test images through the row codec (rowcodec.h) and the threaded PNG
+// encoder (pngenc.h), decoding the PNGs with the vendored stb_image. Prints one line
+// per failure and exits 1 if there was any.
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/rowcodec.h"
+#include "../common/pngenc.h"
+#include "../common/utils.h"
+#include "test_images.h"
+
+static const int part_counts[] = { 1, 2, 3, 7 };
+static const int thread_counts[] = { 1, 4 };
+static const char* levels[] = { "store", "fast", "default", "best" };
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// Pack the image in `parts` row ranges, each on its own as a rank would, and unpack
+// every range into a new image. Returns 1 if it comes back unchanged.
+static int check_rows(const test_image* t, const unsigned char* img, size_t stride, int parts) {
+    size_t row_bytes = (size_t)t->width * 3;
+    unsigned char* out = malloc(row_bytes * (size_t)t->height);
+    unsigned char* buf = malloc(row_pack_bound(t->height, row_bytes));
+    int ok = out && buf;
+    for (int p = 0; ok && p < parts; p++) {
+        int first = (int)((long long)t->height * p / parts);
+        int rows = (int)((long long)t->height * (p + 1) / parts) - first;
+        size_t n = row_pack(img + (size_t)first * stride, rows, row_bytes, stride, buf);
+        unsigned char* dst = out + (size_t)first * row_bytes;
+        // a stream cut short must be refused, not read past
+        ok = n <= row_pack_bound(rows, row_bytes)
+             && (n == 0 || !row_unpack(buf, n - 1, rows, row_bytes, row_bytes, dst))
+             && row_unpack(buf, n, rows, row_bytes, row_bytes, dst);
+    }
+    ok = ok && test_image_equal(out, img, t->width, t->height, stride);
+    free(buf);
+    free(out);
+    return ok;
+}
+
+// Write the image as a PNG at `level` with `threads` threads and read it back. Returns
+// 1 if stb_image decodes the same pixels.
+static int check_png(const test_image* t, const unsigned char* img, size_t stride, int level,
+                     int threads, const char* path) {
+    omp_set_num_threads(threads);
+    if (!png_write_file(path, img, t->width, t->height, stride, level)) return 0;
+    int width, height, channels;
+    unsigned char* back = stbi_load(path, &width, &height, &channels, 3);
+    int ok = back && width == t->width && height == t->height && channels == 3
+             && test_image_equal(back, img, width, height, stride);
+    stbi_image_free(back);
+    remove(path);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "codec_check.png";
+    int checks = 0, failures = 0;
+    for (int i = 0; i < TEST_IMAGE_COUNT; i++) {
+        const test_image* t = &test_images[i];
+        // rows a few bytes apart, so both codecs must honour the stride
+        size_t stride = (size_t)t->width * 3 + 5;
+        unsigned char* img = test_image_make(t, stride);
+        if (!img) {
+            fprintf(stderr, "Out of memory for the %s image\n", t->name);
+            return 1;
+        }
+        for (int p = 0; p < COUNT(part_counts); p++, checks++) {
+            if (!check_rows(t, img, stride, part_counts[p])) {
+                printf("FAIL row codec: %s, %d parts\n", t->name, part_counts[p]);
+                failures++;
+            }
+        }
+        for (int l = 0; l < COUNT(levels); l++) {
+            int level;
+            parse_png_level(levels[l], &level);
+            for (int k = 0; k < COUNT(thread_counts); k++, checks++) {
+                if (!check_png(t, img, stride, level, thread_counts[k], path)) {
+                    printf("FAIL png: %s, level %s, %d threads\n", t->name, levels[l],
+                           thread_counts[k]);
+                    failures++;
+                }
+            }
+        }
+        free(img);
+    }
+    printf("%d of %d codec checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+// Writes the test images with png_write_rows_mpi (png_mpi.h), every rank encoding its
+// own strip of rows, and decodes them on rank 0 with the vendored stb_image. Run it on
+// several rank counts; rank 0 prints one line per failure and the job exits 1 if there
+// was any.
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/pngenc.h"
+#include "../common/png_mpi.h"
+#include "../common/utils.h"
+#include "test_images.h"
+
+static const char* levels[] = { "store", "fast", "default", "best" };
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const char* path = argc > 1 ? argv[1] : "png_mpi_check.png";
+
+    int checks = 0, failures = 0;
+    for (int i = 0; i < TEST_IMAGE_COUNT; i++) {
+        const test_image* t = &test_images[i];
+        size_t stride = (size_t)t->width * 3 + 5;
+        unsigned char* img = test_image_make(t, stride);
+        if (!img) {
+            fprintf(stderr, "Rank %d: out of memory for the %s image\n", rank, t->name);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        // rows in rank order, as even as they go; the 5x3 images leave some ranks none
+        int first = (int)((long long)t->height * rank / size);
+        int rows = (int)((long long)t->height * (rank + 1) / size) - first;
+        for (int l = 0; l < COUNT(levels); l++, checks++) {
+            int level;
+            parse_png_level(levels[l], &level);
+            int ok = png_write_rows_mpi(path, t->width, t->height, first, rows,
+                                        img + (size_t)first * stride, stride, level,
+                                        MPI_COMM_WORLD);
+            if (ok && rank == 0) {
+                int width, height, channels;
+                unsigned char* back = stbi_load(path, &width, &height, &channels, 3);
+                ok = back && width == t->width && height == t->height && channels == 3
+                     && test_image_equal(back, img, width, height, stride);
+                stbi_image_free(back);
+                remove(path);
+            }
+            if (!ok && rank == 0) {
+                printf("FAIL png: %s, level %s, %d ranks\n", t->name, levels[l], size);
+                failures++;
+            }
+            // the next image overwrites the file only once rank 0 has read this one
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+        free(img);
+    }
+    if (rank == 0)
+        printf("%d of %d parallel PNG checks passed on %d ranks\n", checks - failures, checks,
+               size);
+    MPI_Bcast(&failures, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+// test_images.h
+#ifndef TEST_IMAGES_H
+#define TEST_IMAGES_H
+
+#include <stddef.h>
+
+// Test images for the codec checks, as packed RGB rows
+typedef enum { TEST_NOISE, TEST_FLAT } test_pattern;
+
+typedef struct {
+    const char* name;
+    test_pattern pattern;
+    int width, height;
+} test_image;
+
+// Noise and flat images big enough for several encoder parts, and a tiny 5x3 one
+#define TEST_IMAGE_COUNT 4
+extern const test_image test_images[TEST_IMAGE_COUNT];
+
+// A new `t->width` x `t->height` RGB image with rows `stride` bytes apart, or NULL if
+// memory runs out. The same test_image always gives the same pixels.
+unsigned char* test_image_make(const test_image* t, size_t stride);
+
+// Whether the packed RGB rows at `img` match `expect` (rows `stride` bytes apart)
+int test_image_equal(const unsigned char* img, const unsigned char* expect, int width,
+                     int height, size_t stride);
+
+#endif